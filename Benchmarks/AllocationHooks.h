@@ -0,0 +1,251 @@
+#pragma once
+
+// Catches every heap allocation and free in the process, for the console apps that check or count them.
+//
+// The file including this defines `onAllocation()` and `onDeallocation()`, which are called from inside the hooks,
+// so they mustn't allocate or lock themselves. Include it from one file per executable only, as it replaces the
+// global `operator new` and `operator delete`, including their aligned forms.
+//
+// On Linux, `malloc()`, `calloc()`, `realloc()`, `free()`, `posix_memalign()` and `aligned_alloc()` are interposed
+// too, forwarding to the C library's own through `dlsym (RTLD_NEXT, ...)`, so allocations that don't go through
+// `operator new` are caught as well. Elsewhere only `operator new` and `operator delete` are.
+
+#include <juce_core/juce_core.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if JUCE_LINUX
+    #include <dlfcn.h>
+#elif JUCE_WINDOWS
+    #include <malloc.h>
+#endif
+
+/// Called before every allocation, with the name of the function that was called.
+static void onAllocation (const char* function) noexcept;
+
+/// Called before every free of anything but a null pointer, with the name of the function that was called.
+static void onDeallocation (const char* function) noexcept;
+
+namespace AllocationHooks
+{
+#if JUCE_LINUX
+template <typename Function>
+static Function* findNextSymbol (const char* name)
+{
+    return reinterpret_cast<Function*> (dlsym (RTLD_NEXT, name));
+}
+
+// The C library's own allocation functions, looked up on the first call to any of the hooks
+static void* (*nextMalloc) (size_t) = nullptr;
+static void* (*nextCalloc) (size_t, size_t) = nullptr;
+static void* (*nextRealloc) (void*, size_t) = nullptr;
+static int (*nextPosixMemalign) (void**, size_t, size_t) = nullptr;
+static void (*nextFree) (void*) = nullptr;
+static bool isLookingUpNextFunctions = false;
+
+// `dlsym()` may allocate while the functions above are looked up, before there's a real `malloc()` to forward to.
+// Those allocations come from here, zeroed, and are never freed.
+alignas (std::max_align_t) static char bootstrapBuffer[8192];
+static size_t bootstrapBufferUsed = 0;
+
+static void* allocateFromBootstrapBuffer (const size_t size) noexcept
+{
+    const auto alignedSize = (size + alignof (std::max_align_t) - 1) & ~(alignof (std::max_align_t) - 1);
+    if (alignedSize > sizeof (bootstrapBuffer) - bootstrapBufferUsed)
+        return nullptr;
+
+    auto* ptr = bootstrapBuffer + bootstrapBufferUsed;
+    bootstrapBufferUsed += alignedSize;
+    return ptr;
+}
+
+static bool isFromBootstrapBuffer (const void* ptr) noexcept
+{
+    return ptr >= bootstrapBuffer && ptr < bootstrapBuffer + sizeof (bootstrapBuffer);
+}
+
+/// Runs before `main()`, from the first allocation in the process, which is still single-threaded.
+static void lookUpNextFunctions() noexcept
+{
+    if (nextFree != nullptr || isLookingUpNextFunctions)
+        return;
+
+    isLookingUpNextFunctions = true;
+    nextMalloc = findNextSymbol<void* (size_t)> ("malloc");
+    nextCalloc = findNextSymbol<void* (size_t, size_t)> ("calloc");
+    nextRealloc = findNextSymbol<void* (void*, size_t)> ("realloc");
+    nextPosixMemalign = findNextSymbol<int (void**, size_t, size_t)> ("posix_memalign");
+    nextFree = findNextSymbol<void (void*)> ("free");
+    isLookingUpNextFunctions = false;
+}
+
+// The unhooked allocation functions, which all the hooks forward to
+static void* allocate (const size_t size) noexcept
+{
+    lookUpNextFunctions();
+    return nextMalloc != nullptr ? nextMalloc (size) : allocateFromBootstrapBuffer (size);
+}
+
+static void* allocateZeroed (const size_t count, const size_t size) noexcept
+{
+    lookUpNextFunctions();
+    return nextCalloc != nullptr ? nextCalloc (count, size) : allocateFromBootstrapBuffer (count * size);
+}
+
+static void* reallocate (void* ptr, const size_t size) noexcept
+{
+    lookUpNextFunctions();
+    if (! isFromBootstrapBuffer (ptr))
+        return nextRealloc (ptr, size);
+
+    // Moves out of the bootstrap buffer, copying as much as there can have been
+    auto* newPtr = allocate (size);
+    if (newPtr != nullptr)
+        std::memcpy (newPtr, ptr, std::min (size, static_cast<size_t> (bootstrapBuffer + sizeof (bootstrapBuffer) - static_cast<char*> (ptr))));
+    return newPtr;
+}
+
+static int allocateAlignedTo (void** ptr, const size_t alignment, const size_t size) noexcept
+{
+    lookUpNextFunctions();
+    return nextPosixMemalign != nullptr ? nextPosixMemalign (ptr, alignment, size) : ENOMEM;
+}
+
+static void release (void* ptr) noexcept
+{
+    if (isFromBootstrapBuffer (ptr))
+        return;
+
+    lookUpNextFunctions();
+    if (nextFree != nullptr) // otherwise it was allocated while looking up the functions, and is leaked
+        nextFree (ptr);
+}
+
+static void* allocateAligned (const size_t size, const size_t alignment) noexcept
+{
+    void* ptr = nullptr;
+    return allocateAlignedTo (&ptr, std::max (alignment, sizeof (void*)), size) == 0 ? ptr : nullptr;
+}
+
+static void releaseAligned (void* ptr) noexcept { release (ptr); }
+#else
+static void* allocate (const size_t size) noexcept { return std::malloc (size); }
+static void release (void* ptr) noexcept { std::free (ptr); }
+
+    #if JUCE_WINDOWS
+static void* allocateAligned (const size_t size, const size_t alignment) noexcept { return _aligned_malloc (size, alignment); }
+static void releaseAligned (void* ptr) noexcept { _aligned_free (ptr); }
+    #else
+static void* allocateAligned (const size_t size, const size_t alignment) noexcept
+{
+    void* ptr = nullptr;
+    return posix_memalign (&ptr, std::max (alignment, sizeof (void*)), size) == 0 ? ptr : nullptr;
+}
+
+static void releaseAligned (void* ptr) noexcept { std::free (ptr); }
+    #endif
+#endif
+} // namespace AllocationHooks
+
+//==============================================================================
+#if JUCE_LINUX
+extern "C" void* malloc (size_t size) noexcept
+{
+    onAllocation ("malloc");
+    return AllocationHooks::allocate (size);
+}
+
+extern "C" void* calloc (size_t count, size_t size) noexcept
+{
+    onAllocation ("calloc");
+    return AllocationHooks::allocateZeroed (count, size);
+}
+
+extern "C" void* realloc (void* ptr, size_t size) noexcept
+{
+    onAllocation ("realloc");
+    return AllocationHooks::reallocate (ptr, size);
+}
+
+extern "C" int posix_memalign (void** ptr, size_t alignment, size_t size) noexcept
+{
+    onAllocation ("posix_memalign");
+    return AllocationHooks::allocateAlignedTo (ptr, alignment, size);
+}
+
+extern "C" void* aligned_alloc (size_t alignment, size_t size) noexcept
+{
+    onAllocation ("aligned_alloc");
+    return AllocationHooks::allocateAligned (size, alignment);
+}
+
+extern "C" void free (void* ptr) noexcept
+{
+    if (ptr != nullptr)
+        onDeallocation ("free");
+    AllocationHooks::release (ptr);
+}
+#endif
+
+//==============================================================================
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept
+{
+    onAllocation ("operator new");
+    return AllocationHooks::allocate (size == 0 ? 1 : size);
+}
+
+void* operator new (std::size_t size)
+{
+    if (auto* ptr = operator new (size, std::nothrow))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size) { return operator new (size); }
+void* operator new[] (std::size_t size, const std::nothrow_t& tag) noexcept { return operator new (size, tag); }
+
+void* operator new (std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    onAllocation ("operator new");
+    return AllocationHooks::allocateAligned (size == 0 ? 1 : size, static_cast<std::size_t> (alignment));
+}
+
+void* operator new (std::size_t size, std::align_val_t alignment)
+{
+    if (auto* ptr = operator new (size, alignment, std::nothrow))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size, std::align_val_t alignment) { return operator new (size, alignment); }
+void* operator new[] (std::size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept { return operator new (size, alignment, tag); }
+
+void operator delete (void* ptr) noexcept
+{
+    if (ptr != nullptr)
+        onDeallocation ("operator delete");
+    AllocationHooks::release (ptr);
+}
+
+void operator delete[] (void* ptr) noexcept { operator delete (ptr); }
+void operator delete (void* ptr, std::size_t) noexcept { operator delete (ptr); }
+void operator delete[] (void* ptr, std::size_t) noexcept { operator delete (ptr); }
+void operator delete (void* ptr, const std::nothrow_t&) noexcept { operator delete (ptr); }
+void operator delete[] (void* ptr, const std::nothrow_t&) noexcept { operator delete (ptr); }
+
+void operator delete (void* ptr, std::align_val_t) noexcept
+{
+    if (ptr != nullptr)
+        onDeallocation ("operator delete");
+    AllocationHooks::releaseAligned (ptr);
+}
+
+void operator delete[] (void* ptr, std::align_val_t alignment) noexcept { operator delete (ptr, alignment); }
+void operator delete (void* ptr, std::size_t, std::align_val_t alignment) noexcept { operator delete (ptr, alignment); }
+void operator delete[] (void* ptr, std::size_t, std::align_val_t alignment) noexcept { operator delete (ptr, alignment); }
+void operator delete (void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept { operator delete (ptr, alignment); }
+void operator delete[] (void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept { operator delete (ptr, alignment); }
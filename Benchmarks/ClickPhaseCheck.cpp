@@ -0,0 +1,169 @@
+// Checks that every beat plays the click phase within 1/16 of a sample of its ideal position, and that every
+// fractionally delayed phase of a click sounds the same, so consecutive clicks only differ in their timing and not in
+// their tone or loudness. Compares the energy of each phase and the shape of its peak (the normalised autocorrelation
+// over the first few lags) against the average over all phases, for the embedded kit and for a bright synthetic click
+// with lots of energy near Nyquist, at the native rate and when resampled.
+// Exits with 1 on failure, so it can run on build machines.
+//
+// ClickPhaseCheck
+
+#include "ClickSampleLibrary.h"
+#include <array>
+#include <cmath>
+#include <cstdio>
+
+//==============================================================================
+static constexpr double ENERGY_TOLERANCE = 0.005; // relative to the average energy of all phases
+static constexpr double SHAPE_TOLERANCE = 0.005; // absolute, on the normalised autocorrelation
+static constexpr int NUM_SHAPE_LAGS = 4;
+
+struct PhaseMeasurement
+{
+    double energy = 0.0;
+    std::array<double, NUM_SHAPE_LAGS> shape {}; // autocorrelation at lags 1 to NUM_SHAPE_LAGS, divided by the energy
+};
+
+static PhaseMeasurement measure (const ClickSample& click)
+{
+    // Rendered through `addTo()`, the same way the engine plays it
+    juce::AudioBuffer<double> rendered (1, click.getNumSamples());
+    rendered.clear();
+    click.addTo (rendered, 0, 0, click.getNumSamples());
+
+    const auto* samples = rendered.getReadPointer (0);
+    PhaseMeasurement result;
+    for (int i = 0; i < rendered.getNumSamples(); ++i)
+        result.energy += samples[i] * samples[i];
+
+    for (int lag = 1; lag <= NUM_SHAPE_LAGS; ++lag)
+    {
+        double sum = 0.0;
+        for (int i = lag; i < rendered.getNumSamples(); ++i)
+            sum += samples[i] * samples[i - lag];
+        result.shape[static_cast<size_t> (lag - 1)] = result.energy > 0.0 ? sum / result.energy : 0.0;
+    }
+    return result;
+}
+
+/// Returns false, and prints which phase is off, if the phases of `layer` don't match.
+static bool checkLayer (const char* name, const double sampleRate, const ClickSampleLibrary::ClickSampleSet::Layer& layer)
+{
+    std::array<PhaseMeasurement, ClickSampleLibrary::NUM_CLICK_PHASES> measurements;
+    PhaseMeasurement average;
+    for (size_t phase = 0; phase < layer.size(); ++phase)
+    {
+        measurements[phase] = measure (layer[phase]);
+        average.energy += measurements[phase].energy / static_cast<double> (layer.size());
+        for (size_t lag = 0; lag < average.shape.size(); ++lag)
+            average.shape[lag] += measurements[phase].shape[lag] / static_cast<double> (layer.size());
+    }
+
+    if (average.energy <= 0.0)
+    {
+        std::printf ("FAILED: %s at %g Hz is silent\n", name, sampleRate);
+        return false;
+    }
+
+    bool passed = true;
+    for (size_t phase = 0; phase < measurements.size(); ++phase)
+    {
+        const double energyError = measurements[phase].energy / average.energy - 1.0;
+        if (std::abs (energyError) > ENERGY_TOLERANCE)
+        {
+            std::printf ("FAILED: %s at %g Hz, phase %d has %+.2f%% of the average energy\n", name, sampleRate, static_cast<int> (phase), energyError * 100.0);
+            passed = false;
+        }
+
+        for (size_t lag = 0; lag < average.shape.size(); ++lag)
+        {
+            const double shapeError = measurements[phase].shape[lag] - average.shape[lag];
+            if (std::abs (shapeError) > SHAPE_TOLERANCE)
+            {
+                std::printf ("FAILED: %s at %g Hz, phase %d has a different peak shape (autocorrelation at lag %d is %.4f, average %.4f)\n",
+                             name, sampleRate, static_cast<int> (phase), static_cast<int> (lag + 1), measurements[phase].shape[lag], average.shape[lag]);
+                passed = false;
+            }
+        }
+    }
+    return passed;
+}
+
+static bool checkClickSamples (const char* kitName, const ClickSampleLibrary::ClickSampleSet& set)
+{
+    const juce::String prefix (kitName);
+    bool passed = checkLayer ((prefix + " downbeat").toRawUTF8(), set.sampleRate, set.downbeat);
+    passed = checkLayer ((prefix + " beat").toRawUTF8(), set.sampleRate, set.beat) && passed;
+    return passed;
+}
+
+/// Returns false, and prints the first offset that's off, if any beat from -1/2 to 1/2 a sample after its sample
+/// plays a phase more than 1/16 of a sample from where it should be.
+static bool checkPhaseChoice()
+{
+    constexpr int NUM_OFFSETS = 10000;
+    constexpr double MAX_ERROR = 0.5 / ClickSampleLibrary::PHASES_PER_SAMPLE + 1.0e-6;
+    for (int i = 0; i <= NUM_OFFSETS; ++i)
+    {
+        const auto offset = static_cast<float> (i) / NUM_OFFSETS - 0.5f;
+        const int phase = ClickSampleLibrary::getPhase (offset);
+        const double error = ClickSampleLibrary::getPhaseDelay (phase) - offset;
+        if (phase < 0 || phase >= ClickSampleLibrary::NUM_CLICK_PHASES || std::abs (error) > MAX_ERROR)
+        {
+            std::printf ("FAILED: a beat %+.4f samples after its sample plays phase %d, %+.4f samples off\n", offset, phase, error);
+            return false;
+        }
+    }
+    return true;
+}
+
+/// A Hann-windowed burst of white noise, written to an in-memory WAV so it's decoded like any other kit. Most of its
+/// energy is near Nyquist, where a phase that skips the resampling filter, or goes through it twice, stands out.
+static ClickSample makeBrightClick (juce::AudioFormatManager& formatManager, const double sampleRate)
+{
+    constexpr int LENGTH = 256;
+    juce::AudioBuffer<float> noise (1, LENGTH);
+    juce::Random random (1234);
+    for (int i = 0; i < LENGTH; ++i)
+    {
+        const auto window = 0.5f - 0.5f * std::cos (juce::MathConstants<float>::twoPi * static_cast<float> (i) / (LENGTH - 1));
+        noise.setSample (0, i, window * (random.nextFloat() * 2.0f - 1.0f) * 0.5f);
+    }
+
+    juce::MemoryBlock wav;
+    {
+        juce::WavAudioFormat format;
+        auto* stream = new juce::MemoryOutputStream (wav, false);
+        const std::unique_ptr<juce::AudioFormatWriter> writer (format.createWriterFor (stream, sampleRate, 1, 24, {}, 0));
+        if (writer == nullptr)
+        {
+            delete stream;
+            return {};
+        }
+        writer->writeFromAudioSampleBuffer (noise, 0, LENGTH);
+    }
+    return ClickSample::fromMemory (formatManager, wav.getData(), wav.getSize());
+}
+
+int main()
+{
+    constexpr std::array sampleRates = { 44100.0, 48000.0, 88200.0, 96000.0 };
+    bool passed = checkPhaseChoice();
+
+    const auto clickSampleLibrary = ClickSampleLibrary::getInstance();
+    for (const auto sampleRate : sampleRates)
+        passed = checkClickSamples ("Embedded", *clickSampleLibrary->getClickSamples (sampleRate)) && passed;
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    ClickSampleLibrary::Kit brightKit;
+    brightKit.downbeat = makeBrightClick (formatManager, 48000.0);
+    brightKit.beat = brightKit.downbeat;
+    for (const auto sampleRate : sampleRates)
+        passed = checkClickSamples ("Bright", *ClickSampleLibrary::buildClickSamples (brightKit, sampleRate)) && passed;
+
+    if (! passed)
+        return 1;
+
+    std::printf ("PASSED: every beat plays the nearest click phase, and every phase has the same energy and peak shape\n");
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Headless benchmark for `Metronome::process`.
+// Sweeps click sounds, block sizes, sample rates, tempos and time signatures, and reports the average cost per sample, the slowest
+// block and how many heap allocations happened per block. No audio device or GUI is needed, so it runs on build machines.
+// Then compares N tracks in one `MetronomeBank` against N separate `Metronome`s.
+
+#include "AllocationHooks.h"
+#include "Metronome.h"
+#include "MetronomeBank.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Count every heap allocation in the process, so we can tell if the audio path allocates
+static std::atomic<long long> numAllocations { 0 };
+
+static void onAllocation (const char*) noexcept { ++numAllocations; }
+static void onDeallocation (const char*) noexcept {}
+
+//==============================================================================
+struct BenchmarkCase
+{
+    ClickSound clickSound;
+    int blockSize;
+    double sampleRate;
+    double bpm;
+    TimeSignature timeSignature;
+};
+
+struct BenchmarkResult
+{
+    double nanosecondsPerSample = 0;
+    double worstBlockMicroseconds = 0;
+    double realtimeBudgetMicroseconds = 0;
+    double allocationsPerBlock = 0;
+};
+
+static BenchmarkResult runCase (const BenchmarkCase& benchmarkCase, const double secondsOfAudio)
+{
+    using Clock = std::chrono::steady_clock;
+
+    Metronome metronome;
+    metronome.prepareToPlay (benchmarkCase.sampleRate, benchmarkCase.blockSize);
+    metronome.setBPM (benchmarkCase.bpm);
+    metronome.setTimeSignature (benchmarkCase.timeSignature);
+    metronome.setClickSound (benchmarkCase.clickSound);
+
+    juce::AudioBuffer<float> buffer (2, benchmarkCase.blockSize);
+    const auto numBlocks = std::max (static_cast<long long> (secondsOfAudio * benchmarkCase.sampleRate / benchmarkCase.blockSize), 1LL);
+
+    // Warm up caches and branch predictors before measuring
+    for (int block = 0; block < 16; ++block)
+        metronome.process (buffer);
+
+    Clock::duration total {};
+    Clock::duration worst {};
+    const auto allocationsBefore = numAllocations.load();
+
+    for (long long block = 0; block < numBlocks; ++block)
+    {
+        const auto start = Clock::now();
+        metronome.process (buffer);
+        const auto elapsed = Clock::now() - start;
+
+        total += elapsed;
+        worst = std::max (worst, elapsed);
+    }
+
+    const auto numAllocationsInRun = numAllocations.load() - allocationsBefore;
+    const auto numSamples = static_cast<double> (numBlocks) * benchmarkCase.blockSize;
+
+    BenchmarkResult result;
+    result.nanosecondsPerSample = static_cast<double> (std::chrono::duration_cast<std::chrono::nanoseconds> (total).count()) / numSamples;
+    result.worstBlockMicroseconds = static_cast<double> (std::chrono::duration_cast<std::chrono::nanoseconds> (worst).count()) / 1000.0;
+    result.realtimeBudgetMicroseconds = benchmarkCase.blockSize / benchmarkCase.sampleRate * 1.0e6;
+    result.allocationsPerBlock = static_cast<double> (numAllocationsInRun) / static_cast<double> (numBlocks);
+    return result;
+}
+
+//==============================================================================
+/// Nanoseconds per sample to render `numTracks` tracks at different tempos, either in one bank or as separate metronomes.
+static double runTracksCase (const int numTracks, const bool useBank, const double secondsOfAudio)
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 512;
+    const auto getTrackBpm = [] (const int track) { return 60.0 + 7.0 * track; };
+
+    MetronomeBank bank;
+    std::vector<std::unique_ptr<Metronome>> metronomes;
+    if (useBank)
+    {
+        for (int track = 0; track < numTracks; ++track)
+            bank.addTrack (getTrackBpm (track), { { 4 }, { 4 } });
+        bank.prepareToPlay (sampleRate, blockSize);
+    }
+    else
+    {
+        for (int track = 0; track < numTracks; ++track)
+        {
+            auto& metronome = *metronomes.emplace_back (std::make_unique<Metronome>());
+            metronome.prepareToPlay (sampleRate, blockSize);
+            metronome.setBPM (getTrackBpm (track));
+        }
+    }
+
+    // Separate metronomes each render their own buffer, to be summed like separate plugin instances would be
+    juce::AudioBuffer<float> buffer (2, blockSize);
+    juce::AudioBuffer<float> trackBuffer (2, blockSize);
+    const auto numBlocks = std::max (static_cast<long long> (secondsOfAudio * sampleRate / blockSize), 1LL);
+
+    const auto start = Clock::now();
+    for (long long block = 0; block < numBlocks; ++block)
+    {
+        if (useBank)
+        {
+            bank.process (buffer);
+            continue;
+        }
+
+        buffer.clear();
+        for (auto& metronome : metronomes)
+        {
+            metronome->process (trackBuffer);
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+                buffer.addFrom (channel, 0, trackBuffer, channel, 0, blockSize);
+        }
+    }
+    const auto elapsed = Clock::now() - start;
+
+    return static_cast<double> (std::chrono::duration_cast<std::chrono::nanoseconds> (elapsed).count()) / (static_cast<double> (numBlocks) * blockSize);
+}
+
+//==============================================================================
+/// Nanoseconds per sample to fill a double-precision host buffer with `numChannels` channels, either rendered into
+/// directly, or rendered as float and converted both ways, as hosts do for plugins without double-precision processing.
+static double runDoublePrecisionCase (const int numChannels, const bool renderDirectly, const double secondsOfAudio)
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 512;
+
+    Metronome metronome;
+    metronome.prepareToPlay (sampleRate, blockSize);
+    metronome.setBPM (300.0);
+
+    juce::AudioBuffer<double> hostBuffer (numChannels, blockSize);
+    juce::AudioBuffer<float> floatBuffer (numChannels, blockSize);
+    const auto numBlocks = std::max (static_cast<long long> (secondsOfAudio * sampleRate / blockSize), 1LL);
+
+    const auto start = Clock::now();
+    for (long long block = 0; block < numBlocks; ++block)
+    {
+        if (renderDirectly)
+        {
+            metronome.process (hostBuffer);
+            continue;
+        }
+
+        floatBuffer.makeCopyOf (hostBuffer, true);
+        metronome.process (floatBuffer);
+        hostBuffer.makeCopyOf (floatBuffer, true);
+    }
+    const auto elapsed = Clock::now() - start;
+
+    return static_cast<double> (std::chrono::duration_cast<std::chrono::nanoseconds> (elapsed).count()) / (static_cast<double> (numBlocks) * blockSize);
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    // Optional first argument: seconds of audio to render per case
+    const double secondsOfAudio = argc > 1 ? std::max (std::atof (argv[1]), 0.01) : 2.0;
+
+    // Every case makes its own metronome. Holding the library keeps the decoded clicks and each sample rate's phases
+    // alive between cases, so the sweep times `process()` rather than decoding and resampling them again every case.
+    const auto clickSampleLibrary = ClickSampleLibrary::getInstance();
+
+    constexpr std::array clickSounds = { ClickSound::samples, ClickSound::synth };
+    constexpr std::array blockSizes = { 1, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192 };
+    constexpr std::array sampleRates = { 44100.0, 48000.0, 96000.0, 192000.0, 384000.0 };
+    constexpr std::array bpms = { 20.0, 120.0, 300.0, 1000.0 };
+    const std::array<TimeSignature, 4> timeSignatures = { { { { 4 }, { 4 } }, { { 3 }, { 4 } }, { { 7 }, { 8 } }, { { 5 }, { 16 } } } };
+
+    std::printf ("%8s %10s %10s %8s %6s | %12s %16s %16s %14s\n", "sound", "block", "rate", "bpm", "sig", "ns/sample", "worst block us", "budget us", "allocs/block");
+
+    std::vector<BenchmarkCase> cases;
+    for (const auto clickSound : clickSounds)
+        for (const auto blockSize : blockSizes)
+            for (const auto sampleRate : sampleRates)
+                for (const auto bpm : bpms)
+                    for (const auto& timeSignature : timeSignatures)
+                        cases.push_back ({ clickSound, blockSize, sampleRate, bpm, timeSignature });
+
+    int numCasesAllocating = 0;
+    for (const auto& benchmarkCase : cases)
+    {
+        const auto result = runCase (benchmarkCase, secondsOfAudio);
+        if (result.allocationsPerBlock > 0)
+            ++numCasesAllocating;
+
+        std::printf ("%8s %10d %10.0f %8.0f %3d/%-2d | %12.3f %16.3f %16.3f %14.4f\n",
+                     benchmarkCase.clickSound == ClickSound::synth ? "synth" : "samples",
+                     benchmarkCase.blockSize,
+                     benchmarkCase.sampleRate,
+                     benchmarkCase.bpm,
+                     benchmarkCase.timeSignature.numerator,
+                     benchmarkCase.timeSignature.denominator,
+                     result.nanosecondsPerSample,
+                     result.worstBlockMicroseconds,
+                     result.realtimeBudgetMicroseconds,
+                     result.allocationsPerBlock);
+    }
+
+    if (numCasesAllocating > 0)
+        std::printf ("\nWARNING: %d cases allocated on the audio path\n", numCasesAllocating);
+
+    std::printf ("\n%8s | %16s %20s\n", "tracks", "bank ns/sample", "separate ns/sample");
+    for (const int numTracks : { 1, 2, 4, 8, 16, 32, 64 })
+        std::printf ("%8d | %16.3f %20.3f\n", numTracks, runTracksCase (numTracks, true, secondsOfAudio), runTracksCase (numTracks, false, secondsOfAudio));
+
+    std::printf ("\n%8s | %16s %20s\n", "channels", "double ns/sample", "converted ns/sample");
+    for (const int numChannels : { 1, 2 })
+        std::printf ("%8d | %16.3f %20.3f\n", numChannels, runDoublePrecisionCase (numChannels, true, secondsOfAudio), runDoublePrecisionCase (numChannels, false, secondsOfAudio));
+
+    return 0;
+}
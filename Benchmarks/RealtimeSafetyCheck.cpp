@@ -0,0 +1,323 @@
+// Stress test for the real-time safety of the audio path.
+// Drives the plugin's own `AudioPluginAudioProcessor::processBlock()`, the way a host does: through a fake play head
+// with transport jumps and loops, in single and double precision, with the stem outputs turned on and off, huge block
+// sizes and one MIDI buffer that starts out empty. A second thread stands in for the editor, sending random settings,
+// presets, playback changes and click kits, and reading beat events and timing statistics. Fails if the audio thread
+// ever allocates, frees memory or waits on a lock while processing a block.
+// Exits with 1 on failure, so it can run on build machines.
+//
+// RealtimeSafetyCheck [--blocks=20000] [--seed=<random>]
+//
+// Allocations are caught by the hooks in `AllocationHooks.h`: the global `operator new` and `operator delete` in
+// all their forms and, on Linux, the C library's `malloc()` family. Blocking locks are caught by interposing the
+// pthread and semaphore wait functions, which only works on Linux, so elsewhere only allocations through
+// `operator new` are checked. Try-locks never block, so they're allowed.
+
+#include "AllocationHooks.h"
+#include "PluginProcessor.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#if JUCE_LINUX
+    #include <pthread.h>
+    #include <semaphore.h>
+#endif
+
+//==============================================================================
+// True while the simulated audio thread is inside its callback
+static thread_local bool isInAudioCallback = false;
+
+static std::atomic<int> numViolations { 0 };
+static std::atomic<const char*> firstViolation { nullptr };
+
+/// Called from inside the hooks, so it mustn't allocate or lock either.
+static void checkRealtimeSafe (const char* operation) noexcept
+{
+    if (isInAudioCallback && numViolations++ == 0)
+        firstViolation = operation;
+}
+
+static void onAllocation (const char* function) noexcept { checkRealtimeSafe (function); }
+static void onDeallocation (const char* function) noexcept { checkRealtimeSafe (function); }
+
+#if JUCE_LINUX
+// `juce::CriticalSection`, `std::mutex` and friends all end up in one of these when they have to wait
+extern "C" int pthread_mutex_lock (pthread_mutex_t* mutex) noexcept
+{
+    static auto* next = AllocationHooks::findNextSymbol<int (pthread_mutex_t*)> ("pthread_mutex_lock");
+    checkRealtimeSafe ("pthread_mutex_lock");
+    return next (mutex);
+}
+
+extern "C" int pthread_rwlock_rdlock (pthread_rwlock_t* lock) noexcept
+{
+    static auto* next = AllocationHooks::findNextSymbol<int (pthread_rwlock_t*)> ("pthread_rwlock_rdlock");
+    checkRealtimeSafe ("pthread_rwlock_rdlock");
+    return next (lock);
+}
+
+extern "C" int pthread_rwlock_wrlock (pthread_rwlock_t* lock) noexcept
+{
+    static auto* next = AllocationHooks::findNextSymbol<int (pthread_rwlock_t*)> ("pthread_rwlock_wrlock");
+    checkRealtimeSafe ("pthread_rwlock_wrlock");
+    return next (lock);
+}
+
+extern "C" int pthread_cond_wait (pthread_cond_t* condition, pthread_mutex_t* mutex)
+{
+    static auto* next = AllocationHooks::findNextSymbol<int (pthread_cond_t*, pthread_mutex_t*)> ("pthread_cond_wait");
+    checkRealtimeSafe ("pthread_cond_wait");
+    return next (condition, mutex);
+}
+
+extern "C" int sem_wait (sem_t* semaphore)
+{
+    static auto* next = AllocationHooks::findNextSymbol<int (sem_t*)> ("sem_wait");
+    checkRealtimeSafe ("sem_wait");
+    return next (semaphore);
+}
+
+static constexpr bool CAN_CHECK_LOCKS = true;
+#else
+static constexpr bool CAN_CHECK_LOCKS = false;
+#endif
+
+//==============================================================================
+static double randomBpm (juce::Random& random)
+{
+    // Mostly the extremes, where the most beats land in a block or a beat lasts longest
+    constexpr std::array extremeBpms = { 1.0, 20.0, 1000.0, 5000.0, 20000.0 };
+    return random.nextBool() ? extremeBpms[static_cast<size_t> (random.nextInt (static_cast<int> (extremeBpms.size())))]
+                             : 20.0 + random.nextDouble() * 980.0;
+}
+
+static TimeSignature randomTimeSignature (juce::Random& random)
+{
+    return { { 1 + random.nextInt (RhythmPattern::MAX_BEATS_PER_MEASURE) }, { 1 << random.nextInt (7) } };
+}
+
+static MetronomeSettings randomSettings (juce::Random& random)
+{
+    MetronomeSettings settings;
+    settings.bpm = randomBpm (random);
+    settings.timeSignature = randomTimeSignature (random);
+    settings.clickSound = random.nextBool() ? ClickSound::synth : ClickSound::samples;
+
+    settings.rhythmPattern.pulsesPerBeat = 1 + random.nextInt (AccentPattern::MAX_PULSES_PER_BEAT);
+    for (auto& group : settings.rhythmPattern.groups)
+        group = static_cast<uint8_t> (random.nextInt (5));
+    settings.rhythmPattern.useCustomAccents = random.nextInt (4) == 0;
+    for (auto& accent : settings.rhythmPattern.beatAccents)
+        accent = static_cast<Accent> (random.nextInt (static_cast<int> (Accent::silent) + 1));
+
+    settings.midiOutput.sendNotes = random.nextBool();
+    settings.midiOutput.sendClock = random.nextBool();
+    settings.midiOutput.noteLengthSeconds = random.nextDouble() * 0.5;
+    settings.syncToHost = random.nextInt (3) == 0;
+    settings.lookAheadSeconds = random.nextDouble() * 0.1;
+
+    return settings;
+}
+
+/// Plays back whatever position the check gives it, like a host's transport.
+struct FakePlayHead final : public juce::AudioPlayHead
+{
+    juce::Optional<PositionInfo> getPosition() const override { return position; }
+
+    PositionInfo position;
+};
+
+static juce::AudioPlayHead::PositionInfo randomHostPosition (juce::Random& random, double& ppqPosition, const int blockSize, const double sampleRate)
+{
+    const double bpm = randomBpm (random);
+    const auto timeSignature = randomTimeSignature (random);
+
+    // Occasionally locate somewhere else, otherwise play on from the previous block
+    if (random.nextInt (16) == 0)
+        ppqPosition = random.nextDouble() * 10000.0;
+
+    juce::AudioPlayHead::PositionInfo position;
+    position.setIsPlaying (random.nextInt (8) != 0);
+    position.setBpm (bpm);
+    position.setTimeSignature (juce::AudioPlayHead::TimeSignature { timeSignature.numerator, timeSignature.denominator });
+    position.setPpqPosition (ppqPosition);
+    position.setPpqPositionOfLastBarStart (std::floor (ppqPosition));
+
+    if (random.nextBool())
+    {
+        position.setIsLooping (true);
+        position.setLoopPoints (juce::AudioPlayHead::LoopPoints { std::floor (ppqPosition), ppqPosition + random.nextDouble() * 4.0 });
+    }
+
+    ppqPosition += blockSize * bpm / (60.0 * sampleRate);
+    return position;
+}
+
+/// Writes a small click kit to a temporary folder, so the check also switches to and away from a user's kit.
+static juce::File writeClickKit()
+{
+    const auto folder = juce::File::getSpecialLocation (juce::File::tempDirectory).getNonexistentChildFile ("RealtimeSafetyCheckKit", "");
+    folder.createDirectory();
+
+    juce::WavAudioFormat format;
+    juce::Random random (42);
+    for (const auto* name : { "downbeat", "beat", "subdivision" })
+    {
+        // A decaying noise burst, a different length for each sound
+        juce::AudioBuffer<float> click (1, 2000 + random.nextInt (20000));
+        for (int i = 0; i < click.getNumSamples(); ++i)
+            click.setSample (0, i, (random.nextFloat() * 2.0f - 1.0f) * std::exp (-8.0f * static_cast<float> (i) / static_cast<float> (click.getNumSamples())));
+
+        const auto file = folder.getChildFile (juce::String (name) + ".wav");
+        std::unique_ptr<juce::OutputStream> stream (file.createOutputStream());
+        if (stream == nullptr)
+            continue;
+
+        const std::unique_ptr<juce::AudioFormatWriter> writer (format.createWriterFor (stream.get(), 44100.0, 1, 16, {}, 0));
+        if (writer == nullptr)
+            continue;
+
+        stream.release(); // the writer owns the stream now
+        writer->writeFromAudioSampleBuffer (click, 0, click.getNumSamples());
+    }
+
+    return folder;
+}
+
+/// Turns each stem's output bus on, as mono or stereo, or off, like a host changing the plugin's layout.
+static void setRandomBusesLayout (AudioPluginAudioProcessor& processor, juce::Random& random)
+{
+    auto layout = processor.getBusesLayout();
+    for (int bus = 1; bus <= Metronome::NUM_STEMS; ++bus)
+    {
+        const int choice = random.nextInt (3);
+        layout.getChannelSet (false, bus) = choice == 0 ? juce::AudioChannelSet::disabled()
+                                          : choice == 1 ? juce::AudioChannelSet::mono()
+                                                        : juce::AudioChannelSet::stereo();
+    }
+
+    const bool wasSet = processor.setBusesLayout (layout);
+    jassert (wasSet);
+    juce::ignoreUnused (wasSet);
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    const juce::ArgumentList args (argc, argv);
+    const int numBlocks = args.containsOption ("--blocks") ? std::max (args.getValueForOption ("--blocks").getIntValue(), 1) : 20000;
+    const auto seed = args.containsOption ("--seed") ? args.getValueForOption ("--seed").getLargeIntValue() : juce::Time::currentTimeMillis();
+
+    std::printf ("Checking %d blocks with seed %lld%s\n", numBlocks, static_cast<long long> (seed), CAN_CHECK_LOCKS ? "" : " (allocations only, locks can't be checked on this platform)");
+
+    constexpr std::array blockSizes = { 1, 2, 17, 64, 512, 4096, 32768, 65536 };
+    constexpr std::array sampleRates = { 22050.0, 44100.0, 48000.0, 96000.0, 192000.0 };
+    constexpr int MAX_BLOCK_SIZE = blockSizes.back();
+    constexpr int MAX_CHANNELS = 2 + 2 * Metronome::NUM_STEMS; // stereo main bus and every stem's bus in stereo
+
+    const auto kitFolder = writeClickKit();
+    juce::Random random (seed);
+    AudioPluginAudioProcessor processor;
+    FakePlayHead playHead;
+    processor.setPlayHead (&playHead);
+
+    juce::AudioBuffer<float> floatBuffer (MAX_CHANNELS, MAX_BLOCK_SIZE);
+    juce::AudioBuffer<double> doubleBuffer (MAX_CHANNELS, MAX_BLOCK_SIZE);
+    floatBuffer.clear();
+    doubleBuffer.clear();
+    juce::MidiBuffer midi; // like a host's, reused every block, but with no room reserved
+    double sampleRate = sampleRates[0];
+    double hostPpqPosition = 0.0;
+
+    // Stands in for the message thread, sending settings, presets, playback changes and click kits, and taking beat
+    // events and timing stats while the audio thread runs
+    std::atomic<bool> shouldStop { false };
+    std::thread messageThread ([&processor, &kitFolder, &shouldStop, seed]
+                               {
+                                   juce::Random messageRandom (seed + 1);
+                                   while (! shouldStop)
+                                   {
+                                       processor.setSettings (randomSettings (messageRandom));
+
+                                       if (messageRandom.nextInt (8) == 0)
+                                           processor.togglePlayback();
+                                       if (messageRandom.nextInt (16) == 0)
+                                           processor.storePreset (messageRandom.nextInt (PresetBank::NUM_PRESETS));
+                                       if (messageRandom.nextInt (16) == 0)
+                                           processor.recallPreset (messageRandom.nextInt (PresetBank::NUM_PRESETS));
+                                       if (messageRandom.nextInt (256) == 0)
+                                           processor.loadClickKit (messageRandom.nextBool() ? kitFolder : juce::File());
+                                       if (messageRandom.nextInt (64) == 0)
+                                           processor.beatEvents.setListening (messageRandom.nextInt (4) != 0);
+                                       if (messageRandom.nextInt (64) == 0)
+                                           processor.timingAnalyzer.setEnabled (messageRandom.nextInt (4) != 0);
+
+                                       BeatEvent event;
+                                       while (processor.beatEvents.pop (event))
+                                           juce::ignoreUnused (processor.beatEvents.getPlaybackSampleTime());
+                                       juce::ignoreUnused (processor.timingAnalyzer.getStats());
+                                       std::this_thread::sleep_for (std::chrono::microseconds (200));
+                                   }
+                               });
+
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        // Everything a host does outside the audio callback happens before the check starts
+        if (block % 2000 == 0)
+        {
+            if (block > 0)
+                processor.releaseResources();
+
+            sampleRate = sampleRates[static_cast<size_t> (random.nextInt (static_cast<int> (sampleRates.size())))];
+            setRandomBusesLayout (processor, random);
+            processor.setProcessingPrecision (random.nextBool() ? juce::AudioProcessor::doublePrecision : juce::AudioProcessor::singlePrecision);
+            processor.setRateAndBufferSizeDetails (sampleRate, MAX_BLOCK_SIZE);
+            processor.prepareToPlay (sampleRate, MAX_BLOCK_SIZE);
+        }
+
+        const int blockSize = blockSizes[static_cast<size_t> (random.nextInt (static_cast<int> (blockSizes.size())))];
+        const int numChannels = std::max (processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+        playHead.position = randomHostPosition (random, hostPpqPosition, blockSize, sampleRate);
+
+        // Like a plugin wrapper, clear the host's MIDI buffer, which keeps its storage. The last block's clicks are
+        // still in the audio buffer, so they stand in for the player's hits on the input.
+        midi.clear();
+
+        isInAudioCallback = true;
+        if (processor.isUsingDoublePrecision())
+        {
+            juce::AudioBuffer<double> blockBuffer (doubleBuffer.getArrayOfWritePointers(), numChannels, blockSize);
+            processor.processBlock (blockBuffer, midi);
+        }
+        else
+        {
+            juce::AudioBuffer<float> blockBuffer (floatBuffer.getArrayOfWritePointers(), numChannels, blockSize);
+            processor.processBlock (blockBuffer, midi);
+        }
+        isInAudioCallback = false;
+
+        if (numViolations > 0)
+            break;
+    }
+
+    shouldStop = true;
+    messageThread.join();
+    processor.releaseResources();
+    kitFolder.deleteRecursively();
+
+    std::printf ("%s", processor.audioThreadStats.getSnapshot().toString().toRawUTF8());
+
+    if (numViolations > 0)
+    {
+        std::printf ("FAILED: the audio thread called %s (%d real-time safety violations). Rerun with --seed=%lld to reproduce.\n",
+                     firstViolation.load(),
+                     numViolations.load(),
+                     static_cast<long long> (seed));
+        return 1;
+    }
+
+    std::printf ("PASSED: no allocations%s on the audio thread\n", CAN_CHECK_LOCKS ? " or blocking locks" : "");
+    return 0;
+}
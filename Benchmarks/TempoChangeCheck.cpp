@@ -0,0 +1,110 @@
+// Checks where beats land when the tempo changes while the clock runs: the next beat always follows the last beat
+// played by exactly one beat at the newest tempo (or comes straight away if that's already gone by), however many
+// changes come in between. Changes are made at block boundaries, the same way the engine makes them.
+// Exits with 1 on failure, so it can run on build machines.
+//
+// TempoChangeCheck
+
+#include "BeatClock.h"
+#include <cstdio>
+#include <vector>
+
+//==============================================================================
+static constexpr int BLOCK_SIZE = 100;
+static constexpr double POSITION_TOLERANCE = 1.0e-6; // samples
+
+struct TempoChange
+{
+    juce::int64 atSample = 0; // a multiple of BLOCK_SIZE
+    double samplesPerBeat = 0.0;
+};
+
+struct TestCase
+{
+    const char* name;
+    double samplesPerBeat;
+    double firstBeatPosition;
+    std::vector<TempoChange> changes;
+    juce::int64 length;
+};
+
+/// Where the next beat should go after a change, in samples from the start of the run.
+static double getExpectedNextBeat (const double expectedNextBeat, const bool hasPlayedABeat, const double lastBeat, const juce::int64 now, const double newSamplesPerBeat)
+{
+    const auto nowPosition = static_cast<double> (now);
+    if (hasPlayedABeat)
+        return std::max (lastBeat + newSamplesPerBeat, nowPosition);
+
+    return std::min (expectedNextBeat, nowPosition + newSamplesPerBeat); // the first beat is never pushed back
+}
+
+/// Returns false, and prints the first beat that's off, if the clock doesn't follow `test`.
+static bool checkBeatClock (const TestCase& test)
+{
+    BeatClock clock;
+    clock.setSamplesPerBeat (test.samplesPerBeat);
+    clock.reset (test.firstBeatPosition);
+
+    double samplesPerBeat = test.samplesPerBeat;
+    double expectedNextBeat = test.firstBeatPosition;
+    double lastBeat = 0.0;
+    bool hasPlayedABeat = false;
+    int numBeats = 0;
+
+    for (juce::int64 blockStart = 0; blockStart < test.length; blockStart += BLOCK_SIZE)
+    {
+        for (const auto& change : test.changes)
+        {
+            if (change.atSample != blockStart)
+                continue;
+
+            samplesPerBeat = change.samplesPerBeat;
+            clock.setSamplesPerBeat (samplesPerBeat);
+            expectedNextBeat = getExpectedNextBeat (expectedNextBeat, hasPlayedABeat, lastBeat, blockStart, samplesPerBeat);
+        }
+
+        for (double position = clock.getNextBeatPosition(); BeatClock::isInBlock (position, BLOCK_SIZE); position = clock.advanceToNextBeat())
+        {
+            const double beat = static_cast<double> (blockStart) + position;
+            if (std::abs (beat - expectedNextBeat) > POSITION_TOLERANCE)
+            {
+                std::printf ("FAILED: %s, beat %d at %.3f samples, expected %.3f\n", test.name, numBeats, beat, expectedNextBeat);
+                return false;
+            }
+
+            lastBeat = beat;
+            hasPlayedABeat = true;
+            expectedNextBeat = beat + samplesPerBeat;
+            ++numBeats;
+        }
+        clock.advanceBy (BLOCK_SIZE);
+    }
+
+    if (numBeats == 0)
+    {
+        std::printf ("FAILED: %s played no beats\n", test.name);
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    const std::vector<TestCase> tests = {
+        { "Two slower tempos within one beat", 1000.0, 0.0, { { 1200, 1500.0 }, { 1300, 1800.0 } }, 10000 },
+        { "Three tempo changes within one beat", 1000.0, 0.0, { { 1200, 600.0 }, { 1300, 1400.0 }, { 1500, 900.0 } }, 10000 },
+        { "Speeding up past the next beat", 1000.0, 0.0, { { 1200, 1500.0 }, { 1300, 250.0 }, { 1400, 700.0 } }, 10000 },
+        { "Tempo changes before the first beat", 1000.0, 500.0, { { 100, 300.0 }, { 200, 1000.0 } }, 10000 },
+        { "Fractional tempos over a long run", 1000.3, 0.0, { { 1200, 1234.567 }, { 1300, 987.654 }, { 500000, 333.333 } }, 2000000 },
+    };
+
+    bool passed = true;
+    for (const auto& test : tests)
+        passed = checkBeatClock (test) && passed;
+
+    if (! passed)
+        return 1;
+
+    std::printf ("PASSED: beats follow the last beat at the newest tempo\n");
+    return 0;
+}
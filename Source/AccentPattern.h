@@ -0,0 +1,102 @@
+#pragma once
+
+#include "TimeSignature.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+// How strongly a pulse in the measure is played
+enum class Accent : uint8_t
+{
+    downbeat, // first beat of the measure
+    strong, // first beat of a group, e.g. beats 1, 3 and 5 of 2+2+3/8
+    beat,
+    subdivision, // pulses between beats, e.g. the "and" of 8th notes
+    silent
+};
+
+/// How loud a click for `accent` is played with the downbeat or beat sound: group accents and subdivisions are played
+/// quieter, unless they have sounds of their own.
+[[nodiscard]] constexpr float getAccentGain (const Accent accent) noexcept
+{
+    return accent == Accent::strong ? 0.7f : (accent == Accent::subdivision ? 0.5f : 1.0f);
+}
+
+/// Describes the accents and subdivisions to play in each measure, on top of the time signature.
+/// Trivially copyable and fixed size, so it can be sent to the audio thread in a `MetronomeSnapshot`.
+struct RhythmPattern
+{
+    static constexpr int MAX_BEATS_PER_MEASURE = 99;
+    static constexpr int MAX_GROUPS = 16;
+
+    // Number of evenly spaced clicks per beat, e.g. 2 for 8th notes in 4/4, 3 for triplets, 4 for 16ths
+    int pulsesPerBeat = 1;
+
+    // Beat grouping for accents, e.g. { 2, 2, 3 } for 2+2+3/8. A group of 0 ends the list, so by default every
+    // measure is a single group with just the downbeat accented.
+    std::array<uint8_t, MAX_GROUPS> groups {};
+
+    // When true, `beatAccents` sets the accent of each beat in the measure instead of `groups`
+    bool useCustomAccents = false;
+    std::array<Accent, MAX_BEATS_PER_MEASURE> beatAccents {};
+
+    bool operator== (const RhythmPattern& other) const = default;
+};
+
+/// A measure compiled into a flat table of per-pulse accents.
+///
+/// The table is rebuilt only when the time signature or pattern changes. While playing, the scheduler just walks it
+/// with a cursor, so dense subdivisions and grouped meters cost no more per pulse than plain beats did.
+/// The table is a fixed-size array, so compiling on the audio thread never allocates.
+class AccentPattern
+{
+public:
+    static constexpr int MAX_PULSES_PER_BEAT = 4;
+    static constexpr int MAX_PULSES_PER_MEASURE = RhythmPattern::MAX_BEATS_PER_MEASURE * MAX_PULSES_PER_BEAT;
+
+    AccentPattern() { compile ({ { 4 }, { 4 } }, {}); }
+
+    void compile (const TimeSignature& timeSignature, const RhythmPattern& pattern) noexcept
+    {
+        const int beatsPerMeasure = std::clamp (timeSignature.beatsPerMeasure, 1, RhythmPattern::MAX_BEATS_PER_MEASURE);
+        pulsesPerBeat = std::clamp (pattern.pulsesPerBeat, 1, MAX_PULSES_PER_BEAT);
+        numPulses = beatsPerMeasure * pulsesPerBeat;
+
+        // Accent each beat, either as given or from the start of each group
+        std::array<Accent, RhythmPattern::MAX_BEATS_PER_MEASURE> beatAccents {};
+        if (pattern.useCustomAccents)
+        {
+            beatAccents = pattern.beatAccents;
+        }
+        else
+        {
+            beatAccents.fill (Accent::beat);
+            int groupStart = 0;
+            for (const auto groupSize : pattern.groups)
+            {
+                if (groupSize == 0 || groupStart >= beatsPerMeasure)
+                    break;
+
+                beatAccents[static_cast<size_t> (groupStart)] = Accent::strong;
+                groupStart += groupSize;
+            }
+            beatAccents[0] = Accent::downbeat;
+        }
+
+        for (int beat = 0; beat < beatsPerMeasure; ++beat)
+        {
+            auto* pulse = pulses.data() + beat * pulsesPerBeat;
+            pulse[0] = beatAccents[static_cast<size_t> (beat)];
+            std::fill (pulse + 1, pulse + pulsesPerBeat, Accent::subdivision);
+        }
+    }
+
+    [[nodiscard]] int getPulsesPerBeat() const noexcept { return pulsesPerBeat; }
+    [[nodiscard]] int getNumPulses() const noexcept { return numPulses; }
+    [[nodiscard]] Accent operator[] (const int pulseIndex) const noexcept { return pulses[static_cast<size_t> (pulseIndex)]; }
+
+private:
+    std::array<Accent, MAX_PULSES_PER_MEASURE> pulses {};
+    int pulsesPerBeat = 1;
+    int numPulses = 0;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <type_traits>
+
+/// Adds `numSamples` of `source`, scaled by `gain`, into `destination`.
+///
+/// Clicks are always stored and synthesised as floats. A float destination uses `FloatVectorOperations`, and a double
+/// one converts each sample as it's added, in the same single pass, so double-precision hosts never need a conversion
+/// copy of the block.
+template <typename SampleType>
+void addSamples (SampleType* destination, const float* source, const float gain, const int numSamples) noexcept
+{
+    static_assert (std::is_same_v<SampleType, float> || std::is_same_v<SampleType, double>);
+
+    if constexpr (std::is_same_v<SampleType, float>)
+    {
+        if (juce::exactlyEqual (gain, 1.0f))
+            juce::FloatVectorOperations::add (destination, source, numSamples);
+        else
+            juce::FloatVectorOperations::addWithMultiply (destination, source, gain, numSamples);
+    }
+    else
+    {
+        for (int index = 0; index < numSamples; ++index)
+            destination[index] += static_cast<double> (source[index] * gain);
+    }
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <juce_core/juce_core.h>
+
+// Set to 0 to compile the audio thread measurements out. Every call then becomes an empty inline function.
+#ifndef METRONOME_AUDIO_THREAD_STATS
+    #define METRONOME_AUDIO_THREAD_STATS 1
+#endif
+
+/// Lightweight measurements of the audio callback: how long each block takes against its real-time budget, how often
+/// it overruns, and how many beats and voices it renders.
+///
+/// The audio thread is the only writer. It stores into relaxed atomics, with no locks, allocations or system calls
+/// besides reading the high resolution clock, so measuring costs a few nanoseconds per block. Any other thread can
+/// take a `Snapshot` at any time, e.g. for the editor to display or to write to a log.
+class AudioThreadStats
+{
+public:
+    static constexpr bool IS_ENABLED = METRONOME_AUDIO_THREAD_STATS != 0;
+
+    /// Histogram buckets of block load, i.e. processing time / real-time budget. Bucket 0 is below 1/1024 of the
+    /// budget, each following bucket doubles the upper bound, and the last bucket counts overruns (a load of 1 or more).
+    static constexpr int NUM_LOAD_BUCKETS = 12;
+
+    struct Snapshot
+    {
+        juce::uint64 numBlocks = 0;
+        juce::uint64 numOverruns = 0;
+        juce::uint64 numBeats = 0;
+        double worstLoad = 0.0;
+        int numActiveVoices = 0;
+        int peakActiveVoices = 0;
+        std::array<juce::uint64, NUM_LOAD_BUCKETS> loadHistogram {};
+
+        /// Load below which blocks are counted in `bucket`. The last bucket has no upper bound.
+        [[nodiscard]] static double getBucketUpperLoad (const int bucket) noexcept
+        {
+            return bucket == NUM_LOAD_BUCKETS - 1 ? std::numeric_limits<double>::infinity() : std::ldexp (1.0, bucket - (NUM_LOAD_BUCKETS - 2));
+        }
+
+        /// A multi-line report, e.g. for `juce::Logger::writeToLog()` or a file.
+        [[nodiscard]] juce::String toString() const
+        {
+            juce::String text;
+            text << "Audio blocks: " << juce::String (numBlocks) << ", overruns: " << juce::String (numOverruns)
+                 << ", worst load: " << juce::String (worstLoad * 100.0, 2) << "%\n"
+                 << "Beats: " << juce::String (numBeats) << ", active voices: " << numActiveVoices << " (peak " << peakActiveVoices << ")\n"
+                 << "Load histogram:\n";
+
+            for (int bucket = 0; bucket < NUM_LOAD_BUCKETS; ++bucket)
+            {
+                const auto label = bucket == NUM_LOAD_BUCKETS - 1 ? juce::String (">= 100%")
+                                                                  : "< " + juce::String (getBucketUpperLoad (bucket) * 100.0, 2) + "%";
+                text << "  " << label.paddedRight (' ', 10) << juce::String (loadHistogram[static_cast<size_t> (bucket)]) << "\n";
+            }
+
+            return text;
+        }
+    };
+
+    /// Times one audio block, from construction to destruction, against the real-time budget of `numSamples`.
+    class ScopedBlockTimer
+    {
+    public:
+        ScopedBlockTimer (AudioThreadStats& statsIn, const int numSamples, const double sampleRate) noexcept
+            : stats (statsIn)
+        {
+#if METRONOME_AUDIO_THREAD_STATS
+            budgetSeconds = sampleRate > 0.0 ? numSamples / sampleRate : 0.0;
+            startTicks = juce::Time::getHighResolutionTicks();
+#else
+            juce::ignoreUnused (numSamples, sampleRate);
+#endif
+        }
+
+        ~ScopedBlockTimer()
+        {
+#if METRONOME_AUDIO_THREAD_STATS
+            stats.addBlock (juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks), budgetSeconds);
+#endif
+        }
+
+    private:
+        [[maybe_unused]] AudioThreadStats& stats;
+        [[maybe_unused]] double budgetSeconds = 0.0;
+        [[maybe_unused]] juce::int64 startTicks = 0;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedBlockTimer)
+    };
+
+    /// Audio thread only. Records one block that took `processingSeconds` out of a budget of `budgetSeconds`.
+    void addBlock (const double processingSeconds, const double budgetSeconds) noexcept
+    {
+#if METRONOME_AUDIO_THREAD_STATS
+        if (resetRequested.exchange (false, std::memory_order_acquire))
+            clear();
+
+        if (budgetSeconds <= 0.0)
+            return;
+
+        const double load = processingSeconds / budgetSeconds;
+        increment (numBlocks);
+        increment (loadHistogram[static_cast<size_t> (getBucket (load))]);
+
+        if (load >= 1.0)
+            increment (numOverruns);
+        if (load > worstLoad.load (std::memory_order_relaxed))
+            worstLoad.store (load, std::memory_order_relaxed);
+#else
+        juce::ignoreUnused (processingSeconds, budgetSeconds);
+#endif
+    }
+
+    /// Audio thread only. Records the beats a block started and the voices left sounding at its end.
+    void addActivity (const int numBeats, const int numActiveVoicesNow) noexcept
+    {
+#if METRONOME_AUDIO_THREAD_STATS
+        numBeatsRendered.store (numBeatsRendered.load (std::memory_order_relaxed) + static_cast<juce::uint64> (numBeats), std::memory_order_relaxed);
+        numActiveVoices.store (numActiveVoicesNow, std::memory_order_relaxed);
+        if (numActiveVoicesNow > peakActiveVoices.load (std::memory_order_relaxed))
+            peakActiveVoices.store (numActiveVoicesNow, std::memory_order_relaxed);
+#else
+        juce::ignoreUnused (numBeats, numActiveVoicesNow);
+#endif
+    }
+
+    /// Any thread. The counters are read one by one, so a snapshot taken mid-block may be a block out between fields.
+    [[nodiscard]] Snapshot getSnapshot() const noexcept
+    {
+        Snapshot snapshot;
+        snapshot.numBlocks = numBlocks.load (std::memory_order_relaxed);
+        snapshot.numOverruns = numOverruns.load (std::memory_order_relaxed);
+        snapshot.numBeats = numBeatsRendered.load (std::memory_order_relaxed);
+        snapshot.worstLoad = worstLoad.load (std::memory_order_relaxed);
+        snapshot.numActiveVoices = numActiveVoices.load (std::memory_order_relaxed);
+        snapshot.peakActiveVoices = peakActiveVoices.load (std::memory_order_relaxed);
+
+        for (size_t bucket = 0; bucket < loadHistogram.size(); ++bucket)
+            snapshot.loadHistogram[bucket] = loadHistogram[bucket].load (std::memory_order_relaxed);
+
+        return snapshot;
+    }
+
+    /// Any thread. The audio thread clears the counters at the start of its next block, so it stays the only writer.
+    void requestReset() noexcept { resetRequested.store (true, std::memory_order_release); }
+
+private:
+    [[nodiscard]] static int getBucket (const double load) noexcept
+    {
+        if (load >= 1.0)
+            return NUM_LOAD_BUCKETS - 1;
+
+        // load = mantissa * 2^exponent with the mantissa in [0.5, 1), so the load is below 2^exponent
+        int exponent = 0;
+        std::frexp (load, &exponent);
+        return load <= 0.0 ? 0 : std::clamp (exponent + NUM_LOAD_BUCKETS - 2, 0, NUM_LOAD_BUCKETS - 2);
+    }
+
+    /// A plain load and store rather than a locked read-modify-write, which is safe with a single writer.
+    static void increment (std::atomic<juce::uint64>& counter) noexcept
+    {
+        counter.store (counter.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void clear() noexcept
+    {
+        for (auto* counter : { &numBlocks, &numOverruns, &numBeatsRendered })
+            counter->store (0, std::memory_order_relaxed);
+        for (auto& bucket : loadHistogram)
+            bucket.store (0, std::memory_order_relaxed);
+
+        worstLoad.store (0.0, std::memory_order_relaxed);
+        peakActiveVoices.store (0, std::memory_order_relaxed);
+    }
+
+    std::atomic<juce::uint64> numBlocks = 0;
+    std::atomic<juce::uint64> numOverruns = 0;
+    std::atomic<juce::uint64> numBeatsRendered = 0;
+    std::atomic<double> worstLoad = 0.0;
+    std::atomic<int> numActiveVoices = 0;
+    std::atomic<int> peakActiveVoices = 0;
+    std::array<std::atomic<juce::uint64>, NUM_LOAD_BUCKETS> loadHistogram {};
+    std::atomic<bool> resetRequested = false;
+};
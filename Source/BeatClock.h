@@ -0,0 +1,104 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+/// Schedules beats at a constant tempo without accumulating rounding error.
+///
+/// Rather than counting whole samples per beat (which rounds every beat and drifts over time), beat `n` ideally
+/// falls at `anchorPosition + n * samplesPerBeat` samples after the anchor. Each beat's position is derived from that
+/// formula and only then rounded to the nearest sample, so the error never exceeds half a sample, no matter how long
+/// the clock runs. Finding a beat costs one multiply-add, and advancing a block is one integer addition.
+class BeatClock
+{
+public:
+    /// Restarts the clock with the next beat `firstBeatPosition` samples after the start of the next block.
+    void reset (const double firstBeatPosition = 0.0) noexcept
+    {
+        anchorPosition = firstBeatPosition;
+        samplesSinceAnchor = 0;
+        beatsSinceAnchor = 0;
+    }
+
+    /// Changes the beat length while running.
+    /// Like the old integer counter, we keep counting from the last beat but never wait longer than one new beat,
+    /// so dragging the BPM slider speeds up or slows down smoothly instead of re-triggering beats.
+    /// The clock is re-anchored on the last beat played, so any further changes before the next beat still count from it.
+    void setSamplesPerBeat (const double newSamplesPerBeat) noexcept
+    {
+        jassert (newSamplesPerBeat > 0.0);
+        if (juce::exactlyEqual (samplesPerBeat, newSamplesPerBeat))
+            return;
+
+        const bool hasPlayedABeat = beatsSinceAnchor > 0;
+        const double firstBeatPosition = reanchor (getNextBeatPosition(), samplesPerBeat, newSamplesPerBeat, hasPlayedABeat);
+        samplesPerBeat = newSamplesPerBeat;
+        if (hasPlayedABeat)
+        {
+            anchorPosition = firstBeatPosition - newSamplesPerBeat;
+            samplesSinceAnchor = 0;
+            beatsSinceAnchor = 1;
+        }
+        else
+        {
+            reset (firstBeatPosition);
+        }
+    }
+
+    /// Where the next beat goes when the beat length changes from `oldSamplesPerBeat` to `newSamplesPerBeat` and the
+    /// next beat was due at `nextBeatPosition`: counting on from the last beat, but never more than one new beat away.
+    /// The first beat after a reset hasn't got a previous beat to count from, so it's just kept from being delayed.
+    [[nodiscard]] static double reanchor (const double nextBeatPosition, const double oldSamplesPerBeat, const double newSamplesPerBeat, const bool hasPlayedABeat) noexcept
+    {
+        const double samplesSinceLastBeat = oldSamplesPerBeat - nextBeatPosition;
+        return hasPlayedABeat ? std::max (newSamplesPerBeat - samplesSinceLastBeat, 0.0)
+                              : juce::jlimit (0.0, newSamplesPerBeat, nextBeatPosition);
+    }
+
+    [[nodiscard]] double getSamplesPerBeat() const noexcept { return samplesPerBeat; }
+
+    /// Ideal position of the next beat in samples, relative to the start of the current block.
+    [[nodiscard]] double getNextBeatPosition() const noexcept
+    {
+        return anchorPosition + static_cast<double> (beatsSinceAnchor) * samplesPerBeat - static_cast<double> (samplesSinceAnchor);
+    }
+
+    /// Moves on to the following beat and returns its ideal position relative to the start of the current block.
+    double advanceToNextBeat() noexcept
+    {
+        ++beatsSinceAnchor;
+        return getNextBeatPosition();
+    }
+
+    /// Jumps to `samplePosition` samples after the anchor, as if the clock had run at a constant tempo to get there.
+    /// The beats it then hands out land on exactly the same samples as they would have without the jump.
+    void seek (const juce::int64 samplePosition) noexcept
+    {
+        jassert (samplesPerBeat > 0.0);
+        samplesSinceAnchor = samplePosition;
+        beatsSinceAnchor = std::max (static_cast<juce::int64> (std::ceil ((static_cast<double> (samplePosition) - 0.5 - anchorPosition) / samplesPerBeat)), juce::int64 { 0 });
+    }
+
+    /// Index of the next beat, counting from the anchor.
+    [[nodiscard]] juce::int64 getNextBeatIndex() const noexcept { return beatsSinceAnchor; }
+
+    /// Moves the start of the current block forward once a block has been processed.
+    void advanceBy (const int numSamples) noexcept { samplesSinceAnchor += numSamples; }
+
+    /// Whether a beat at `position` (relative to the block start) rounds to a sample inside a block of `numSamples`.
+    [[nodiscard]] static bool isInBlock (const double position, const int numSamples) noexcept { return position < numSamples - 0.5; }
+
+    /// The sample index a beat at `position` rounds to. Positions handed out by the clock are never below -0.5.
+    [[nodiscard]] static int toSampleIndex (const double position) noexcept { return std::max (static_cast<int> (position + 0.5), 0); }
+
+    /// How far after its sample (from `toSampleIndex()`) a beat at `position` ideally falls, from -0.5 to 0.5 samples.
+    [[nodiscard]] static float getSubSampleOffset (const double position) noexcept
+    {
+        return static_cast<float> (juce::jlimit (-0.5, 0.5, position - toSampleIndex (position)));
+    }
+
+private:
+    double samplesPerBeat = 0.0;
+    double anchorPosition = 0.0;
+    juce::int64 samplesSinceAnchor = 0;
+    juce::int64 beatsSinceAnchor = 0;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "AccentPattern.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <juce_core/juce_core.h>
+
+/// A click the audio thread played, for the editor to show.
+struct BeatEvent
+{
+    juce::int64 sampleTime = 0; // samples the processor had rendered before the click, see `BeatEventQueue::getPlaybackSampleTime()`
+    int bar = 1; // bars since the metronome started, from 1
+    int beat = 0; // beat in the bar, from 0 on the downbeat. Subdivisions share their beat's number.
+    int beatsPerBar = 4;
+    Accent accent = Accent::beat;
+};
+
+/// Bounded single-producer single-consumer FIFO for sending `BeatEvent`s from the audio thread to the editor.
+///
+/// The mirror image of `MetronomeCommandQueue`: both ends are wait-free, and the audio thread never blocks or allocates.
+/// The audio thread only pushes while someone is listening, so with the editor closed all it costs is one atomic load
+/// per block. It also publishes when each block will be heard in wall-clock time and the sample rate, so the editor can
+/// show each click when it's heard, rather than when the audio thread rendered it. A block is heard once the block
+/// before it has played out, plus any latency the plugin reports to the host. The audio device's own output latency
+/// isn't known to a plugin, so the light can still run that far ahead, usually a few milliseconds.
+class BeatEventQueue
+{
+public:
+    /// Message thread only. Starts or stops the audio thread sending events, e.g. while a beat indicator is on screen.
+    /// Starting throws away anything left over from the last time someone listened, so old beats don't flash up.
+    void setListening (const bool shouldListen) noexcept
+    {
+        if (shouldListen)
+            events.clear();
+
+        listening = shouldListen;
+    }
+
+    [[nodiscard]] bool isListening() const noexcept { return listening; }
+
+    /// Audio thread only. Returns false if the queue is full, in which case the event is dropped.
+    bool push (const BeatEvent& event) noexcept { return events.push (event); }
+
+    /// Message thread only. Takes the oldest event, or returns false if there are none.
+    bool pop (BeatEvent& event) noexcept { return events.pop (event); }
+
+    /// Audio thread only. Call for each block, with the sample time of its first sample and how many samples it'll
+    /// take from now until that sample is heard.
+    void startBlock (const juce::int64 sampleTime, const double sampleRate, const int outputLatencySamples) noexcept
+    {
+        // The mapping is two numbers, written as a sequence lock: the version is odd while they change, so the reader
+        // can tell it read them between blocks, and the audio thread never waits
+        const double newMsPerSample = 1000.0 / sampleRate;
+        const auto version = clockVersion.load (std::memory_order_relaxed);
+        clockVersion.store (version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+
+        msPerSample.store (newMsPerSample, std::memory_order_relaxed);
+        timeOfFirstSampleMs.store (juce::Time::getMillisecondCounterHiRes() + static_cast<double> (outputLatencySamples - sampleTime) * newMsPerSample,
+                                   std::memory_order_relaxed);
+        clockVersion.store (version + 2, std::memory_order_release);
+    }
+
+    /// Message thread only. The sample time being heard now, estimated from when the latest block will be heard.
+    [[nodiscard]] juce::int64 getPlaybackSampleTime() const noexcept
+    {
+        for (;;)
+        {
+            const auto version = clockVersion.load (std::memory_order_acquire);
+            const double firstSampleMs = timeOfFirstSampleMs.load (std::memory_order_relaxed);
+            const double samplePeriodMs = msPerSample.load (std::memory_order_relaxed);
+            std::atomic_thread_fence (std::memory_order_acquire);
+
+            // Read again if the audio thread was writing, so the time and rate always come from the same block
+            if ((version & 1) == 0 && clockVersion.load (std::memory_order_relaxed) == version)
+                return static_cast<juce::int64> ((juce::Time::getMillisecondCounterHiRes() - firstSampleMs) / samplePeriodMs);
+        }
+    }
+
+private:
+    static constexpr int CAPACITY = 1024;
+
+    SpscQueue<BeatEvent, CAPACITY> events;
+
+    std::atomic<bool> listening = false;
+
+    // Wall-clock time sample 0 was heard, and how long a sample lasts, guarded by `clockVersion`
+    std::atomic<juce::uint32> clockVersion = 0;
+    std::atomic<double> timeOfFirstSampleMs = 0.0;
+    std::atomic<double> msPerSample = 1000.0 / 44100.0;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "BeatEventQueue.h"
+#include <juce_gui_basics/juce_gui_basics.h>
+#include <vector>
+
+/// Shows the bar number and lights the beat being played, from the clicks the audio thread sends through a
+/// `BeatEventQueue`.
+///
+/// Events are taken on every display refresh through `juce::VBlankAttachment`, and each is shown once the audio
+/// thread's clock says it's being heard, so the light stays with the click instead of running a block ahead.
+/// Only the beats and bar number that changed are repainted, so even 1000 BPM costs a couple of small repaints per
+/// beat. The attachment only fires while the indicator is on screen, and the audio thread stops sending events when
+/// it's gone.
+class BeatIndicator final : public juce::Component
+{
+public:
+    explicit BeatIndicator (BeatEventQueue& queueIn) : queue (queueIn)
+    {
+        setOpaque (true);
+        pending.reserve (MAX_PENDING_EVENTS);
+        queue.setListening (true);
+    }
+
+    ~BeatIndicator() override { queue.setListening (false); }
+
+    void paint (juce::Graphics& g) override
+    {
+        g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
+
+        g.setColour (juce::Colours::white);
+        g.setFont (14.0f);
+        if (hasShownBeat)
+            g.drawText ("Bar " + juce::String (shown.bar), getBarNumberBounds(), juce::Justification::centredLeft);
+
+        for (int beat = 0; beat < shown.beatsPerBar; ++beat)
+        {
+            g.setColour (hasShownBeat && beat == shown.beat ? getAccentColour (shown.accent) : juce::Colours::darkgrey);
+            g.fillRoundedRectangle (getBeatBounds (beat).toFloat().reduced (2.0f), 3.0f);
+        }
+    }
+
+private:
+    static constexpr size_t MAX_PENDING_EVENTS = 1024;
+    static constexpr int BAR_NUMBER_WIDTH = 70;
+
+    /// Called on every display refresh.
+    void update()
+    {
+        // Take everything the audio thread has sent, oldest first
+        BeatEvent event;
+        while (pending.size() < MAX_PENDING_EVENTS && queue.pop (event))
+            pending.push_back (event);
+
+        if (pending.empty())
+            return;
+
+        // Only the newest click that's being heard by now matters, the rest were too quick to see
+        const auto playbackTime = queue.getPlaybackSampleTime();
+        auto firstNotDue = pending.begin();
+        while (firstNotDue != pending.end() && firstNotDue->sampleTime <= playbackTime)
+            ++firstNotDue;
+
+        if (firstNotDue == pending.begin())
+            return;
+
+        const auto newest = *(firstNotDue - 1);
+        pending.erase (pending.begin(), firstNotDue);
+
+        // Subdivisions leave their beat lit as it was
+        if (hasShownBeat && newest.accent == Accent::subdivision && newest.beat == shown.beat && newest.bar == shown.bar)
+            return;
+
+        show (newest);
+    }
+
+    void show (const BeatEvent& event)
+    {
+        const auto previous = shown;
+        const bool hadShownBeat = hasShownBeat;
+        shown = event;
+        hasShownBeat = true;
+
+        if (! hadShownBeat || event.beatsPerBar != previous.beatsPerBar)
+        {
+            repaint();
+            return;
+        }
+
+        if (event.bar != previous.bar)
+            repaint (getBarNumberBounds());
+
+        repaint (getBeatBounds (previous.beat));
+        repaint (getBeatBounds (event.beat));
+    }
+
+    [[nodiscard]] juce::Rectangle<int> getBarNumberBounds() const { return getLocalBounds().removeFromLeft (BAR_NUMBER_WIDTH); }
+
+    [[nodiscard]] juce::Rectangle<int> getBeatBounds (const int beat) const
+    {
+        const auto beats = getLocalBounds().withTrimmedLeft (BAR_NUMBER_WIDTH);
+        const int numBeats = std::max (shown.beatsPerBar, 1);
+        const int left = beats.getX() + beats.getWidth() * beat / numBeats;
+        const int right = beats.getX() + beats.getWidth() * (beat + 1) / numBeats;
+        return beats.withLeft (left).withRight (right);
+    }
+
+    [[nodiscard]] static juce::Colour getAccentColour (const Accent accent)
+    {
+        switch (accent)
+        {
+            case Accent::downbeat:
+                return juce::Colours::orange;
+            case Accent::strong:
+                return juce::Colours::gold;
+            case Accent::beat:
+            case Accent::subdivision:
+                return juce::Colours::limegreen;
+            case Accent::silent:
+                break;
+        }
+        return juce::Colours::grey;
+    }
+
+    BeatEventQueue& queue;
+    std::vector<BeatEvent> pending; // received but not heard yet, oldest first
+    BeatEvent shown;
+    bool hasShownBeat = false;
+
+    juce::VBlankAttachment vBlankAttachment { this, [this] { update(); } };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BeatIndicator)
+};
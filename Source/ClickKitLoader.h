@@ -0,0 +1,234 @@
+#pragma once
+
+#include "ClickSampleLibrary.h"
+#include "Metronome.h"
+#include "RetiredOwners.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+/// Loads click kits from the user's own sample files on a background thread, and hands them to a `Metronome` on the
+/// audio thread without locks, disk reads or frees there.
+///
+/// A kit is a folder of WAV or AIFF files named after the accents they're for: `downbeat`, `strong`, `beat` and
+/// `subdivision`, e.g. `Downbeat.wav` or `beat soft.aiff`. A downbeat or a beat sound is enough; the other fills in for
+/// it, and strong accents and subdivisions fall back to quieter downbeats and beats. There are no velocity layers: each
+/// accent plays one sample, and if several files match it, the first by name wins, e.g. `beat 1.wav` over `beat 2.wav`.
+///
+/// The loader's thread reads the files through memory-mapped readers, then resamples them and builds their phases.
+/// A finished kit is published with a single atomic pointer exchange, and `update()` switches the metronome to it
+/// between blocks. Clicks already ringing finish from the old kit, which is passed back through a wait-free FIFO once
+/// the last of them has ended, and freed on the loader's thread.
+class ClickKitLoader final : private juce::Thread
+{
+public:
+    using ClickSampleSet = ClickSampleLibrary::ClickSampleSet;
+
+    ClickKitLoader() : juce::Thread ("Click kit loader")
+    {
+        formatManager.registerBasicFormats();
+    }
+
+    ~ClickKitLoader() override { stopThread (4000); }
+
+    /// Message thread only. Starts loading the kit in `folder`, or going back to the embedded clicks if it's
+    /// `juce::File()`. The metronome keeps playing the kit it has until the new one is ready. If the folder has no
+    /// usable sounds, the request is ignored. The loader's thread only starts with the first kit asked for, so a
+    /// plugin that only ever plays the embedded clicks, e.g. when a session restores them, never runs it.
+    void load (const juce::File& folder)
+    {
+        {
+            const juce::ScopedLock lock (requestLock);
+            if (folder == juce::File() && ! isThreadRunning())
+                return; // still playing the embedded clicks
+
+            requestedFolder = folder;
+            hasRequest = true;
+
+            if (! isThreadRunning())
+                startThread();
+        }
+
+        notify();
+    }
+
+    /// The folder of the kit asked for last, or `juce::File()` for the embedded clicks.
+    [[nodiscard]] juce::File getFolder() const
+    {
+        const juce::ScopedLock lock (requestLock);
+        return requestedFolder;
+    }
+
+    /// Call from `prepareToPlay()`, after preparing `metronome`, while the audio thread is stopped. Rebuilds the
+    /// current kit for the new sample rate on the calling thread, so the host doesn't hear the embedded clicks meanwhile.
+    void prepareToPlay (Metronome& metronome, const double newSampleRate)
+    {
+        const juce::ScopedLock lock (buildLock);
+
+        // Preparing the metronome stopped every click and switched it back to the embedded ones, so it's done with
+        // every set it had
+        for (const auto* set : { inUse, retiring, pending.exchange (nullptr) })
+            if (set != nullptr)
+                ownedSets.retire (set);
+        inUse = retiring = nullptr;
+
+        sampleRate = newSampleRate;
+        if (kitVersion == 0) // never asked for a kit, so the metronome's own embedded clicks are right
+        {
+            builtSampleRate = sampleRate;
+            return;
+        }
+
+        const auto set = buildCurrentKit();
+        metronome.setClickSamples (set);
+        inUse = set;
+        notify(); // to free the sets retired above
+    }
+
+    /// Audio thread only, before rendering each block of `numSamples` samples. Switches `metronome` to a newly loaded
+    /// kit, and passes back the kit it replaced once that's rung out. Wait-free, and never frees anything.
+    void update (Metronome& metronome, const int numSamples) noexcept
+    {
+        if (retiring != nullptr && samplesUntilRetired <= 0 && ownedSets.retire (retiring))
+            retiring = nullptr;
+
+        // Only one kit rings out at a time, so a newer one waits until the last switch is done
+        if (retiring == nullptr)
+        {
+            if (const auto* next = pending.exchange (nullptr))
+            {
+                if (inUse != nullptr)
+                {
+                    retiring = inUse;
+                    samplesUntilRetired = inUse->longestClickLength;
+                }
+
+                metronome.setClickSamples (next);
+                inUse = next;
+            }
+        }
+
+        if (retiring != nullptr)
+            samplesUntilRetired -= numSamples;
+    }
+
+private:
+    static constexpr int RETIRED_CAPACITY = 16;
+    static constexpr int COLLECTION_INTERVAL_MS = 250;
+
+    /// Sleeps until `load()` or `prepareToPlay()` wakes it. The audio thread can't wake it, so only while a kit it
+    /// switched away from may still come back to be freed does it also look every `COLLECTION_INTERVAL_MS`.
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            bool isWaitingForRetiredSets = false;
+            {
+                const juce::ScopedLock lock (buildLock);
+                ownedSets.collect();
+                loadRequestedKit();
+
+                if ((kitVersion != builtKitVersion || ! juce::approximatelyEqual (sampleRate, builtSampleRate)) && sampleRate > 0.0)
+                {
+                    // Publish the new kit. If the audio thread never picked up the one before, it's ours to free.
+                    if (const auto* unpicked = pending.exchange (buildCurrentKit()))
+                        ownedSets.disown (unpicked);
+                }
+
+                isWaitingForRetiredSets = ownedSets.getNumOwned() > 1;
+            }
+
+            wait (isWaitingForRetiredSets ? COLLECTION_INTERVAL_MS : -1);
+        }
+    }
+
+    /// Decodes the kit asked for by `load()`, if there's a new request.
+    void loadRequestedKit()
+    {
+        juce::File folder;
+        {
+            const juce::ScopedLock lock (requestLock);
+            if (! hasRequest)
+                return;
+
+            folder = requestedFolder;
+            hasRequest = false;
+        }
+
+        if (folder == juce::File())
+        {
+            kit = nullptr;
+            ++kitVersion;
+            return;
+        }
+
+        // The directory lists files in no particular order, so sort them to always pick the same one for each accent
+        auto files = folder.findChildFiles (juce::File::findFiles, false, "*.wav;*.aif;*.aiff");
+        std::sort (files.begin(), files.end(), [] (const juce::File& a, const juce::File& b)
+                   { return a.getFileName().compareNatural (b.getFileName()) < 0; });
+
+        auto newKit = std::make_shared<ClickSampleLibrary::Kit>();
+        for (const auto& file : files)
+        {
+            const auto name = file.getFileNameWithoutExtension().toLowerCase();
+            auto* sound = name.startsWith ("downbeat") ? &newKit->downbeat
+                        : name.startsWith ("strong")   ? &newKit->strong
+                        : name.startsWith ("sub")      ? &newKit->subdivision
+                        : name.startsWith ("beat")     ? &newKit->beat
+                                                       : nullptr;
+            if (sound != nullptr && sound->getNumSamples() == 0)
+                *sound = ClickSample::fromFile (formatManager, file);
+        }
+
+        if (newKit->downbeat.getNumSamples() == 0 && newKit->beat.getNumSamples() == 0)
+        {
+            DBG ("No downbeat or beat sounds in click kit " << folder.getFullPathName());
+            return;
+        }
+
+        if (newKit->downbeat.getNumSamples() == 0)
+            newKit->downbeat = newKit->beat;
+        else if (newKit->beat.getNumSamples() == 0)
+            newKit->beat = newKit->downbeat;
+
+        kit = std::move (newKit);
+        ++kitVersion;
+    }
+
+    /// Builds the current kit, or gets the embedded clicks, for the current sample rate, and keeps it alive until the
+    /// audio thread passes it back. Called with `buildLock` held.
+    const ClickSampleSet* buildCurrentKit()
+    {
+        builtKitVersion = kitVersion;
+        builtSampleRate = sampleRate;
+        return ownedSets.own (kit != nullptr ? ClickSampleLibrary::buildClickSamples (*kit, sampleRate) : library->getClickSamples (sampleRate));
+    }
+
+    // Message thread and loader thread
+    juce::CriticalSection requestLock;
+    juce::File requestedFolder;
+    bool hasRequest = false;
+
+    // Loader thread and `prepareToPlay()`, under `buildLock`
+    juce::CriticalSection buildLock;
+    juce::AudioFormatManager formatManager;
+    std::shared_ptr<ClickSampleLibrary> library = ClickSampleLibrary::getInstance();
+    std::shared_ptr<const ClickSampleLibrary::Kit> kit; // null for the embedded clicks
+    int kitVersion = 0; // counts the kits loaded
+    int builtKitVersion = 0;
+    double sampleRate = 0.0;
+    double builtSampleRate = 0.0;
+
+    // Loader thread to audio thread
+    std::atomic<const ClickSampleSet*> pending { nullptr };
+
+    // Loader thread and `prepareToPlay()`, and the audio thread passing sets back
+    RetiredOwners<ClickSampleSet, RETIRED_CAPACITY> ownedSets; // every set published that the audio thread may still play
+
+    // Audio thread only, or `prepareToPlay()`
+    const ClickSampleSet* inUse = nullptr; // null while the metronome plays its own embedded clicks
+    const ClickSampleSet* retiring = nullptr; // the set switched away from, until its clicks have rung out
+    int samplesUntilRetired = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ClickKitLoader)
+};
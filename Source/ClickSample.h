@@ -0,0 +1,185 @@
+#pragma once
+
+#include "AddSamples.h"
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <vector>
+
+/// A click sound decoded once into float buffers.
+/// Rendering a click is then a plain vectorised add into the output, instead of decoding the WAV again every audio block.
+class ClickSample
+{
+public:
+    ClickSample() = default;
+
+    /// Longest click read from a file. Anything after this is cut off, so a long file can't eat the memory of its
+    /// resampled phases.
+    static constexpr double MAX_LENGTH_SECONDS = 2.0;
+
+    /// Decodes a whole audio file held in memory (e.g. BinaryData). If the data can't be read, the sample is left empty and renders silence.
+    static ClickSample fromMemory (juce::AudioFormatManager& formatManager, const void* data, const size_t numBytes)
+    {
+        const std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (std::make_unique<juce::MemoryInputStream> (data, numBytes, false)));
+        jassert (reader != nullptr);
+        return reader != nullptr ? fromReader (*reader) : ClickSample();
+    }
+
+    /// Decodes an audio file from disk, e.g. from a user's click kit. WAV and AIFF files are memory-mapped and decoded
+    /// straight from the mapping, without copying them through a stream first. Blocks on disk reads, so never call it
+    /// on the audio thread. If the file can't be read, the sample is left empty and renders silence.
+    static ClickSample fromFile (juce::AudioFormatManager& formatManager, const juce::File& file)
+    {
+        if (auto* format = formatManager.findFormatForFileExtension (file.getFileExtension()))
+        {
+            const std::unique_ptr<juce::MemoryMappedAudioFormatReader> mappedReader (format->createMemoryMappedReader (file));
+            if (mappedReader != nullptr && mappedReader->mapEntireFile())
+                return fromReader (*mappedReader);
+        }
+
+        // Formats that can't be mapped, e.g. compressed ones
+        const std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (file));
+        return reader != nullptr ? fromReader (*reader) : ClickSample();
+    }
+
+    /// A copy of the click resampled to `newSampleRate`, so it keeps its pitch and length at any host sample rate.
+    /// A fractional `delay` (in samples at the new rate) shifts the click later, e.g. for sub-sample accurate onsets.
+    ///
+    /// Uses a Kaiser-windowed sinc filter. It's band-limited: when downsampling, the cutoff drops below the new Nyquist
+    /// frequency, so the click doesn't alias. The filter runs even at the same rate with no delay, so copies made with
+    /// different delays all have the same spectrum. Far too slow for the audio thread, so resample once per rate, e.g.
+    /// in `prepareToPlay()`.
+    [[nodiscard]] ClickSample resampledTo (const double newSampleRate, const double delay = 0.0) const
+    {
+        if (getNumSamples() == 0 || sampleRate <= 0.0 || newSampleRate <= 0.0)
+            return *this;
+
+        static constexpr double ZERO_CROSSINGS = 32.0; // on each side of the filter kernel
+        static constexpr double KAISER_BETA = 9.0; // about 90 dB of stopband attenuation
+        static constexpr double PASSBAND = 0.95; // fraction of the lower of the two Nyquist frequencies kept
+
+        const double step = sampleRate / newSampleRate; // source samples per output sample
+        const double cutoff = PASSBAND * std::min (1.0, newSampleRate / sampleRate); // relative to the source Nyquist frequency
+        const double halfWidth = ZERO_CROSSINGS / cutoff; // in source samples
+        const int radius = static_cast<int> (std::ceil (halfWidth));
+        const int numSourceSamples = getNumSamples();
+        const int numChannels = audio.getNumChannels();
+
+        ClickSample result;
+        result.sampleRate = newSampleRate;
+        result.audio.setSize (numChannels, static_cast<int> (std::ceil (numSourceSamples / step)));
+
+        // Tap j reads source sample `floor (centre) - radius + 1 + j`. The weights only depend on the fraction of the
+        // centre, so they're reused while it repeats, e.g. for every sample of a pure fractional delay.
+        std::vector<float> weights (static_cast<size_t> (2 * radius));
+        double weightsFraction = -1.0;
+
+        for (int outputSample = 0; outputSample < result.getNumSamples(); ++outputSample)
+        {
+            const double centre = (outputSample - delay) * step;
+            const double base = std::floor (centre);
+            const double fraction = centre - base;
+
+            if (! juce::exactlyEqual (fraction, weightsFraction))
+            {
+                for (int tap = 0; tap < 2 * radius; ++tap)
+                {
+                    const double distance = fraction + radius - 1 - tap;
+                    weights[static_cast<size_t> (tap)] = std::abs (distance) < halfWidth
+                                                             ? static_cast<float> (cutoff * sinc (cutoff * distance) * kaiser (distance / halfWidth, KAISER_BETA))
+                                                             : 0.0f;
+                }
+                weightsFraction = fraction;
+            }
+
+            const int firstTap = static_cast<int> (base) - radius + 1;
+            const int begin = std::max (-firstTap, 0);
+            const int end = std::min (2 * radius, numSourceSamples - firstTap);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                const auto* source = audio.getReadPointer (channel);
+                float sum = 0.0f;
+                for (int tap = begin; tap < end; ++tap)
+                    sum += source[firstTap + tap] * weights[static_cast<size_t> (tap)];
+
+                result.audio.setSample (channel, outputSample, sum);
+            }
+        }
+
+        return result;
+    }
+
+    [[nodiscard]] int getNumSamples() const noexcept { return audio.getNumSamples(); }
+    [[nodiscard]] double getSampleRate() const noexcept { return sampleRate; }
+
+    /// Pass as `NumChannels` when the number of output channels is only known at run time.
+    static constexpr int ANY_CHANNELS = 0;
+
+    /// Adds `numSamples` of the click, starting at `readPosition` and scaled by `gain`, into every channel of `dest` starting at `destStartSample`.
+    /// Output channels beyond the sample's channel count reuse its last channel, so a mono click fills a stereo bus.
+    ///
+    /// `dest` can be float or double. Pass its channel count as `NumChannels` when it's known at compile time (e.g. for
+    /// mono and stereo), so the channel loop is unrolled.
+    template <int NumChannels = ANY_CHANNELS, typename SampleType>
+    void addTo (juce::AudioBuffer<SampleType>& dest, const int destStartSample, const int readPosition, const int numSamples, const float gain = 1.0f) const noexcept
+    {
+        jassert (readPosition >= 0 && readPosition + numSamples <= getNumSamples());
+        jassert (NumChannels == ANY_CHANNELS || NumChannels == dest.getNumChannels());
+
+        const int numDestChannels = NumChannels == ANY_CHANNELS ? dest.getNumChannels() : NumChannels;
+        const int numSourceChannels = audio.getNumChannels();
+        for (int channel = 0; channel < numDestChannels; ++channel)
+            addSamples (dest.getWritePointer (channel, destStartSample), audio.getReadPointer (std::min (channel, numSourceChannels - 1), readPosition), gain, numSamples);
+    }
+
+    /// Like `addTo()`, but only into `destChannel` of `dest`, from the click's first channel.
+    template <typename SampleType>
+    void addToChannel (juce::AudioBuffer<SampleType>& dest, const int destChannel, const int destStartSample, const int readPosition, const int numSamples, const float gain = 1.0f) const noexcept
+    {
+        jassert (readPosition >= 0 && readPosition + numSamples <= getNumSamples());
+        jassert (juce::isPositiveAndBelow (destChannel, dest.getNumChannels()));
+
+        addSamples (dest.getWritePointer (destChannel, destStartSample), audio.getReadPointer (0, readPosition), gain, numSamples);
+    }
+
+private:
+    static ClickSample fromReader (juce::AudioFormatReader& reader)
+    {
+        ClickSample sample;
+        if (reader.numChannels == 0 || reader.lengthInSamples <= 0 || reader.sampleRate <= 0.0)
+            return sample;
+
+        const auto numSamples = static_cast<int> (std::min (reader.lengthInSamples, static_cast<juce::int64> (MAX_LENGTH_SECONDS * reader.sampleRate)));
+        sample.audio.setSize (static_cast<int> (reader.numChannels), numSamples);
+        reader.read (&sample.audio, 0, numSamples, 0, true, true);
+        sample.sampleRate = reader.sampleRate;
+        return sample;
+    }
+
+    [[nodiscard]] static double sinc (const double x) noexcept
+    {
+        const double piX = juce::MathConstants<double>::pi * x;
+        return std::abs (piX) < 1.0e-9 ? 1.0 : std::sin (piX) / piX;
+    }
+
+    /// Kaiser window at `position` from -1 to 1.
+    [[nodiscard]] static double kaiser (const double position, const double beta) noexcept
+    {
+        return besselI0 (beta * std::sqrt (1.0 - position * position)) / besselI0 (beta);
+    }
+
+    /// Zeroth order modified Bessel function of the first kind, from its power series.
+    [[nodiscard]] static double besselI0 (const double x) noexcept
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; term > 1.0e-12 * sum; ++k)
+        {
+            term *= (x * x) / (4.0 * k * k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    juce::AudioBuffer<float> audio;
+    double sampleRate = 0;
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "AccentPattern.h"
+#include "BinaryData.h"
+#include "ClickSample.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/// The embedded click samples, decoded once per process and shared read-only by every `Metronome`.
+///
+/// A session with dozens of plugin instances would otherwise decode the WAVs and build the resampled phases once per
+/// instance. Instead, the library is created lazily by the first instance that asks for it, shared through
+/// `std::shared_ptr`, and freed when the last instance lets go. The sets of clicks for each sample rate are built on
+/// first use and immutable afterwards, so instances can read them without locking. User kits are built the same way,
+/// with `buildClickSamples()`, but owned by whoever loads them (see `ClickKitLoader`).
+class ClickSampleLibrary
+{
+public:
+    // Sample clicks start on a whole sample, so each click is also kept delayed by every 1/8 of a sample from -1/2 to
+    // 1/2, and the phase nearest each beat's ideal position is played, never more than 1/16 of a sample away.
+    // Both ends are kept so offsets near +1/2 are as close as those near -1/2. Phase `PHASES_PER_SAMPLE / 2` has no delay.
+    static constexpr int PHASES_PER_SAMPLE = 8;
+    static constexpr int NUM_CLICK_PHASES = PHASES_PER_SAMPLE + 1;
+
+    /// The phase to play for a click ideally `subSampleOffset` samples (from -0.5 to 0.5) after its sample.
+    [[nodiscard]] static int getPhase (const float subSampleOffset) noexcept
+    {
+        return std::clamp (PHASES_PER_SAMPLE / 2 + static_cast<int> (std::lround (subSampleOffset * PHASES_PER_SAMPLE)), 0, NUM_CLICK_PHASES - 1);
+    }
+
+    /// How far phase `phase` is delayed, in samples.
+    [[nodiscard]] static double getPhaseDelay (const int phase) noexcept
+    {
+        return static_cast<double> (phase - PHASES_PER_SAMPLE / 2) / PHASES_PER_SAMPLE;
+    }
+
+    /// Click sounds at their original sample rate, e.g. the embedded clicks or a user's kit. Strong accents and
+    /// subdivisions are optional, and left empty when a kit doesn't have its own sounds for them.
+    struct Kit
+    {
+        ClickSample downbeat;
+        ClickSample strong;
+        ClickSample beat;
+        ClickSample subdivision;
+    };
+
+    /// The click samples at one sample rate, with a fractionally delayed copy for each phase.
+    struct ClickSampleSet
+    {
+        using Layer = std::array<ClickSample, NUM_CLICK_PHASES>;
+
+        double sampleRate = 0;
+        Layer downbeat;
+        Layer strong; // empty if the kit has no strong accent sound
+        Layer beat;
+        Layer subdivision; // empty if the kit has no subdivision sound
+        int longestClickLength = 0; // in samples, over every layer and phase
+
+        /// The layer to play for `accent`, and whether it's the accent's own sound. If not, it's the downbeat or beat
+        /// sound, to be played quieter.
+        [[nodiscard]] std::pair<const Layer&, bool> getLayer (const Accent accent) const noexcept
+        {
+            using Choice = std::pair<const Layer&, bool>;
+
+            if (accent == Accent::downbeat)
+                return { downbeat, true };
+            if (accent == Accent::strong)
+                return strong[0].getNumSamples() > 0 ? Choice { strong, true } : Choice { downbeat, false };
+            if (accent == Accent::subdivision)
+                return subdivision[0].getNumSamples() > 0 ? Choice { subdivision, true } : Choice { beat, false };
+            return { beat, true };
+        }
+
+        /// The click to play for `accent`, ideally `subSampleOffset` samples after its sample, and the gain to play it
+        /// at, from `getAccentGain()` when it's standing in for an accent without a sound of its own.
+        [[nodiscard]] std::pair<const ClickSample&, float> getClick (const Accent accent, const float subSampleOffset) const noexcept
+        {
+            const auto [layer, isOwnSound] = getLayer (accent);
+            return { layer[static_cast<size_t> (getPhase (subSampleOffset))], isOwnSound ? 1.0f : getAccentGain (accent) };
+        }
+    };
+
+    /// Resamples `kit` to `sampleRate` and builds the fractionally delayed phases of every click. Far too slow for the
+    /// audio thread, so call it on a background thread or in `prepareToPlay()`.
+    [[nodiscard]] static std::shared_ptr<const ClickSampleSet> buildClickSamples (const Kit& kit, const double sampleRate)
+    {
+        auto set = std::make_shared<ClickSampleSet>();
+        set->sampleRate = sampleRate;
+
+        // Each phase is resampled and delayed in one pass from the original, so every phase goes through the filter
+        // exactly once and consecutive clicks only differ in their timing, not their tone
+        const auto buildLayer = [&set, sampleRate] (ClickSampleSet::Layer& layer, const ClickSample& original)
+        {
+            for (int phase = 0; phase < NUM_CLICK_PHASES; ++phase)
+            {
+                layer[static_cast<size_t> (phase)] = original.resampledTo (sampleRate, getPhaseDelay (phase));
+                set->longestClickLength = std::max (set->longestClickLength, layer[static_cast<size_t> (phase)].getNumSamples());
+            }
+        };
+
+        buildLayer (set->downbeat, kit.downbeat);
+        buildLayer (set->strong, kit.strong);
+        buildLayer (set->beat, kit.beat);
+        buildLayer (set->subdivision, kit.subdivision);
+        return set;
+    }
+
+    /// The process-wide library, decoding the click samples if no one holds it yet. Safe to call from any thread but
+    /// the audio thread.
+    static std::shared_ptr<ClickSampleLibrary> getInstance()
+    {
+        static juce::CriticalSection instanceLock;
+        static std::weak_ptr<ClickSampleLibrary> instance;
+
+        const juce::ScopedLock lock (instanceLock);
+        auto library = instance.lock();
+        if (library == nullptr)
+        {
+            library = std::shared_ptr<ClickSampleLibrary> (new ClickSampleLibrary());
+            instance = library;
+        }
+        return library;
+    }
+
+    /// Sample rate of the embedded WAVs.
+    [[nodiscard]] double getOriginalSampleRate() const noexcept { return embeddedKit.downbeat.getSampleRate(); }
+
+    /// The clicks for `sampleRate`, resampling the originals and building their fractionally delayed phases the first
+    /// time anyone asks for that rate. Later calls for the same rate just return the shared set. Safe to call from any
+    /// thread but the audio thread. Calls for a rate that's still being built wait for it, rather than building it twice.
+    std::shared_ptr<const ClickSampleSet> getClickSamples (const double sampleRate)
+    {
+        const juce::ScopedLock lock (setsLock);
+
+        for (const auto& set : sets)
+            if (juce::approximatelyEqual (set->sampleRate, sampleRate))
+                return set;
+
+        auto set = buildClickSamples (embeddedKit, sampleRate);
+        sets.push_back (set);
+        return set;
+    }
+
+private:
+    ClickSampleLibrary()
+    {
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        // Decode once here so the audio thread only ever copies floats.
+        embeddedKit.downbeat = ClickSample::fromMemory (formatManager, BinaryData::clickdownbeat_wav, static_cast<size_t> (BinaryData::clickdownbeat_wavSize));
+        embeddedKit.beat = ClickSample::fromMemory (formatManager, BinaryData::clickbeat_wav, static_cast<size_t> (BinaryData::clickbeat_wavSize));
+    }
+
+    Kit embeddedKit; // no strong or subdivision sounds of its own
+
+    juce::CriticalSection setsLock;
+    std::vector<std::shared_ptr<const ClickSampleSet>> sets; // one per sample rate asked for
+};
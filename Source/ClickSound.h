@@ -0,0 +1,8 @@
+#pragma once
+
+// Which sound the metronome clicks with
+enum class ClickSound
+{
+    samples, // the embedded click recordings
+    synth // clicks synthesised on the fly by `ClickSynth`
+};
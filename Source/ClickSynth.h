@@ -0,0 +1,254 @@
+#pragma once
+
+#include "AddSamples.h"
+#include "ClickSample.h"
+#include <array>
+#include <cstdint>
+#include <juce_audio_basics/juce_audio_basics.h>
+
+/// Synthesises clicks on the fly, as an alternative to the embedded click samples.
+///
+/// Needs no sample memory or decoding, and each accent's pitch, level and decay can be changed at any time.
+/// Each voice computes `NUM_LANES` consecutive samples per step as independent lanes (a damped complex rotation for
+/// the sine, per-lane noise generators for the noise burst), so the inner loops have no dependency between samples
+/// and the compiler vectorises them. Voices are summed into a small fixed float scratch buffer that is then added to
+/// every output channel, float or double, with `addSamples()`.
+class ClickSynth
+{
+public:
+    enum class Shape
+    {
+        sine, // enveloped sine "beep"
+        noise // high-passed noise burst
+    };
+
+    struct Sound
+    {
+        Shape shape = Shape::sine;
+        float frequency = 1000.0f; // Hz, only used by `Shape::sine`
+        float level = 0.5f;
+        float decaySeconds = 0.03f; // time to decay by 60 dB
+    };
+
+    ClickSynth()
+    {
+        downbeatSound.frequency = 1760.0f;
+        beatSound.frequency = 880.0f;
+    }
+
+    void prepare (const double sampleRateIn) noexcept
+    {
+        sampleRate = sampleRateIn;
+        reset();
+    }
+
+    /// Silences every voice.
+    void reset() noexcept { numActiveVoices = 0; }
+
+    /// Changes the sounds used by the next clicks. Clicks already sounding keep their old sound.
+    void setSounds (const Sound& downbeat, const Sound& beat) noexcept
+    {
+        downbeatSound = downbeat;
+        beatSound = beat;
+    }
+
+    /// Length in samples of the longest click, i.e. how long a click can keep sounding after its beat.
+    [[nodiscard]] int getLongestSoundLength() const noexcept
+    {
+        return std::max (getSoundLength (downbeatSound), getSoundLength (beatSound));
+    }
+
+    /// Starts a click, which ideally begins `subSampleOffset` samples (from -0.5 to 0.5) after the next sample rendered.
+    void start (const bool isDownbeat, const float gain = 1.0f, const float subSampleOffset = 0.0f) noexcept
+    {
+        auto sound = isDownbeat ? downbeatSound : beatSound;
+        sound.level *= gain;
+        if (sampleRate <= 0.0 || getSoundLength (sound) <= 0)
+            return;
+
+        // When every voice is busy, steal the oldest, which is the one closest to silent
+        auto* voice = &voices[0];
+        if (numActiveVoices < MAX_VOICES)
+            voice = &voices[static_cast<size_t> (numActiveVoices++)];
+        else
+            for (auto& other : voices)
+                if (other.samplesLeft < voice->samplesLeft)
+                    voice = &other;
+
+        voice->start (sound, sampleRate, getSoundLength (sound), subSampleOffset);
+    }
+
+    /// Mixes `numSamples` of every active voice into the buffer, starting at `startSample`. See `ClickSample::addTo()`
+    /// for `NumChannels`.
+    template <int NumChannels = ClickSample::ANY_CHANNELS, typename SampleType>
+    void render (juce::AudioBuffer<SampleType>& buffer, const int startSample, const int numSamples) noexcept
+    {
+        for (int offset = 0; offset < numSamples && numActiveVoices > 0; offset += SCRATCH_SIZE)
+        {
+            const int numSamplesInChunk = std::min (SCRATCH_SIZE, numSamples - offset);
+            juce::FloatVectorOperations::clear (scratch.data(), numSamplesInChunk);
+
+            for (int voiceIndex = 0; voiceIndex < numActiveVoices;)
+            {
+                auto& voice = voices[static_cast<size_t> (voiceIndex)];
+                voice.addTo (scratch.data(), numSamplesInChunk);
+
+                if (voice.samplesLeft <= 0) // finished, so swap in the last active voice to keep them packed
+                    voice = voices[static_cast<size_t> (--numActiveVoices)];
+                else
+                    ++voiceIndex;
+            }
+
+            const int numChannels = NumChannels == ClickSample::ANY_CHANNELS ? buffer.getNumChannels() : NumChannels;
+            for (int channel = 0; channel < numChannels; ++channel)
+                addSamples (buffer.getWritePointer (channel, startSample + offset), scratch.data(), 1.0f, numSamplesInChunk);
+        }
+    }
+
+    [[nodiscard]] int getNumActiveVoices() const noexcept { return numActiveVoices; }
+
+private:
+    static constexpr int NUM_LANES = 8;
+    static constexpr int MAX_VOICES = 32;
+    static constexpr int SCRATCH_SIZE = 256;
+
+    [[nodiscard]] int getSoundLength (const Sound& sound) const noexcept
+    {
+        return sound.level > 0.0f ? static_cast<int> (std::ceil (sound.decaySeconds * sampleRate)) : 0;
+    }
+
+    struct Voice
+    {
+        void start (const Sound& sound, const double sampleRate, const int lengthInSamples, const float subSampleOffset) noexcept
+        {
+            shape = sound.shape;
+            samplesLeft = lengthInSamples;
+
+            // Lane k first renders the click `firstLaneTime + k` samples after its onset. A click starting after the
+            // first sample leaves that sample silent, by queueing it as an empty pending sample, and starts the lanes
+            // one sample later. This costs nothing per sample, and the onset lands between samples.
+            const bool startsLate = subSampleOffset > 0.0f;
+            const double firstLaneTime = (startsLate ? 1.0 : 0.0) - subSampleOffset;
+            pending.fill (0.0f);
+            numPending = startsLate ? 1 : 0;
+
+            // Per-sample decay that reaches -60 dB after `lengthInSamples`
+            const double decayPerSample = std::pow (0.001, 1.0 / std::max (lengthInSamples, 1));
+            const double decayPerStep = std::pow (decayPerSample, NUM_LANES);
+
+            if (shape == Shape::sine)
+            {
+                // Lane k starts at time t = firstLaneTime + k of the click: level * decay^t * e^(i * omega * t)
+                const double omega = juce::MathConstants<double>::twoPi * sound.frequency / sampleRate;
+                for (int lane = 0; lane < NUM_LANES; ++lane)
+                {
+                    const double time = firstLaneTime + lane;
+                    const double amplitude = sound.level * std::pow (decayPerSample, time);
+                    real[static_cast<size_t> (lane)] = static_cast<float> (amplitude * std::cos (omega * time));
+                    imag[static_cast<size_t> (lane)] = static_cast<float> (amplitude * std::sin (omega * time));
+                }
+
+                // Each step rotates every lane on by NUM_LANES samples and applies their decay
+                stepReal = static_cast<float> (decayPerStep * std::cos (omega * NUM_LANES));
+                stepImag = static_cast<float> (decayPerStep * std::sin (omega * NUM_LANES));
+            }
+            else
+            {
+                // `real` holds the envelope, `imag` is unused
+                for (int lane = 0; lane < NUM_LANES; ++lane)
+                {
+                    real[static_cast<size_t> (lane)] = static_cast<float> (sound.level * std::pow (decayPerSample, firstLaneTime + lane));
+                    noiseState[static_cast<size_t> (lane)] = 0x9e3779b9u * static_cast<uint32_t> (lane + 1);
+                }
+
+                stepReal = static_cast<float> (decayPerStep);
+                previousNoise = 0.0f;
+            }
+        }
+
+        /// Adds the next `numSamples` samples of the click (or what's left of it) into `output`.
+        void addTo (float* output, int numSamples) noexcept
+        {
+            numSamples = std::min (numSamples, samplesLeft);
+            samplesLeft -= numSamples;
+
+            int written = 0;
+
+            // Samples left over from the last step of the previous call
+            for (; numPending > 0 && written < numSamples; --numPending)
+                output[written++] += pending[static_cast<size_t> (NUM_LANES - numPending)];
+
+            for (; written + NUM_LANES <= numSamples; written += NUM_LANES)
+                addNextStep (output + written);
+
+            if (written < numSamples)
+            {
+                pending.fill (0.0f);
+                addNextStep (pending.data());
+
+                for (numPending = NUM_LANES; written < numSamples; --numPending)
+                    output[written++] += pending[static_cast<size_t> (NUM_LANES - numPending)];
+            }
+        }
+
+        /// Adds the next NUM_LANES samples into `output`. No sample depends on another in the same step.
+        void addNextStep (float* output) noexcept
+        {
+            if (shape == Shape::sine)
+            {
+                for (size_t lane = 0; lane < NUM_LANES; ++lane)
+                {
+                    output[lane] += imag[lane];
+
+                    const float nextReal = real[lane] * stepReal - imag[lane] * stepImag;
+                    imag[lane] = real[lane] * stepImag + imag[lane] * stepReal;
+                    real[lane] = nextReal;
+                }
+            }
+            else
+            {
+                std::array<float, NUM_LANES> noise {};
+                for (size_t lane = 0; lane < NUM_LANES; ++lane)
+                {
+                    // xorshift32 per lane
+                    auto state = noiseState[lane];
+                    state ^= state << 13;
+                    state ^= state >> 17;
+                    state ^= state << 5;
+                    noiseState[lane] = state;
+
+                    noise[lane] = static_cast<float> (static_cast<int32_t> (state)) * (1.0f / 2147483648.0f) * real[lane];
+                    real[lane] *= stepReal;
+                }
+
+                // First difference high-pass, which takes the rumble out of the burst
+                output[0] += 0.5f * (noise[0] - previousNoise);
+                for (size_t lane = 1; lane < NUM_LANES; ++lane)
+                    output[lane] += 0.5f * (noise[lane] - noise[lane - 1]);
+
+                previousNoise = noise[NUM_LANES - 1];
+            }
+        }
+
+        Shape shape = Shape::sine;
+        int samplesLeft = 0;
+
+        alignas (32) std::array<float, NUM_LANES> real {};
+        alignas (32) std::array<float, NUM_LANES> imag {};
+        std::array<uint32_t, NUM_LANES> noiseState {};
+        float stepReal = 0.0f;
+        float stepImag = 0.0f;
+        float previousNoise = 0.0f;
+
+        std::array<float, NUM_LANES> pending {};
+        int numPending = 0;
+    };
+
+    double sampleRate = 0.0;
+    Sound downbeatSound;
+    Sound beatSound;
+
+    std::array<Voice, MAX_VOICES> voices;
+    int numActiveVoices = 0;
+    alignas (32) std::array<float, SCRATCH_SIZE> scratch {};
+};
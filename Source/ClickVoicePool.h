@@ -0,0 +1,87 @@
+#pragma once
+
+#include "ClickSample.h"
+#include <vector>
+
+/// Fixed-size pool of click playheads, so a new click doesn't cut off the tail of the previous one.
+///
+/// Voices are allocated in `prepare()` and never on the audio thread. Active voices are kept packed at the front of
+/// the pool, so rendering only visits the voices that are actually sounding, not the whole capacity.
+/// When every voice is busy, the click that has been playing longest is stolen.
+class ClickVoicePool
+{
+public:
+    static constexpr int ALL_CHANNELS = -1;
+
+    void prepare (const int maxVoices)
+    {
+        voices.assign (static_cast<size_t> (maxVoices), {});
+        numActiveVoices = 0;
+    }
+
+    /// Silences every voice.
+    void reset() noexcept { numActiveVoices = 0; }
+
+    /// Starts `sample` playing from its beginning at `gain`. The sample must outlive the voice.
+    /// By default the click plays into every channel, or pass `outputChannel` to play it into just that one.
+    void start (const ClickSample& sample, const float gain = 1.0f, const int outputChannel = ALL_CHANNELS) noexcept
+    {
+        if (voices.empty() || sample.getNumSamples() == 0)
+            return;
+
+        if (numActiveVoices < static_cast<int> (voices.size()))
+        {
+            voices[static_cast<size_t> (numActiveVoices++)] = { &sample, 0, gain, outputChannel };
+            return;
+        }
+
+        // Steal the oldest voice. Bounded by the pool size, and only reached at extreme tempos.
+        auto oldest = voices.begin();
+        for (auto voice = voices.begin(); voice != voices.end(); ++voice)
+            if (voice->readPosition > oldest->readPosition)
+                oldest = voice;
+
+        *oldest = { &sample, 0, gain, outputChannel };
+    }
+
+    /// Mixes `numSamples` of every active voice into the buffer, starting at `startSample`. See `ClickSample::addTo()`
+    /// for `NumChannels`.
+    template <int NumChannels = ClickSample::ANY_CHANNELS, typename SampleType>
+    void render (juce::AudioBuffer<SampleType>& buffer, const int startSample, const int numSamples) noexcept
+    {
+        if (numSamples <= 0)
+            return;
+
+        for (int voiceIndex = 0; voiceIndex < numActiveVoices;)
+        {
+            auto& voice = voices[static_cast<size_t> (voiceIndex)];
+            const int numSamplesLeft = voice.sample->getNumSamples() - voice.readPosition;
+            const int numSamplesToRender = std::min (numSamples, numSamplesLeft);
+
+            if (voice.outputChannel == ALL_CHANNELS)
+                voice.sample->addTo<NumChannels> (buffer, startSample, voice.readPosition, numSamplesToRender, voice.gain);
+            else
+                voice.sample->addToChannel (buffer, voice.outputChannel, startSample, voice.readPosition, numSamplesToRender, voice.gain);
+            voice.readPosition += numSamplesToRender;
+
+            if (numSamplesToRender == numSamplesLeft) // finished, so swap in the last active voice to keep them packed
+                voice = voices[static_cast<size_t> (--numActiveVoices)];
+            else
+                ++voiceIndex;
+        }
+    }
+
+    [[nodiscard]] int getNumActiveVoices() const noexcept { return numActiveVoices; }
+
+private:
+    struct Voice
+    {
+        const ClickSample* sample = nullptr;
+        int readPosition = 0;
+        float gain = 1.0f;
+        int outputChannel = ALL_CHANNELS;
+    };
+
+    std::vector<Voice> voices;
+    int numActiveVoices = 0;
+};
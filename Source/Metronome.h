@@ -1,9 +1,19 @@
 
 #pragma once
 
+#include "AccentPattern.h"
+#include "BeatClock.h"
+#include "ClickSample.h"
+#include "ClickSampleLibrary.h"
+#include "ClickSound.h"
+#include "ClickSynth.h"
+#include "ClickVoicePool.h"
+#include "MetronomeSettings.h"
+#include "MidiClickOutput.h"
+#include "TempoMap.h"
 #include "TimeSignature.h"
-#include "BinaryData.h"
-#include <juce_audio_formats/juce_audio_formats.h>
+#include <algorithm>
+#include <array>
 #include <juce_core/juce_core.h>
 #include <juce_dsp/juce_dsp.h>
 #include <span>
@@ -11,42 +21,87 @@
 class Metronome
 {
 public:
-    Metronome()
+    /// A click scheduled in a block.
+    struct Beat
+    {
+        int samplePosition = 0;
+        Accent accent = Accent::beat;
+        float subSampleOffset = 0.0f; // where the beat ideally falls, from -0.5 to 0.5 samples after `samplePosition`
+        int pulseInBar = 0; // pulse of the pattern it plays, from 0 on the downbeat
+        int pulsesPerBeat = 1;
+        int beatsPerBar = 4;
+    };
+
+    /// The kinds of click that can play through outputs of their own, e.g. so each musician's monitor mix can weight
+    /// them differently. Group accents count as beats.
+    enum class Stem
     {
-        loadAudioSamples();
+        downbeat,
+        beat,
+        subdivision
+    };
+
+    static constexpr int NUM_STEMS = 3;
+
+    /// The buffer each stem renders into, indexed by `Stem`. Stems can share a buffer, and are mixed into it. All of
+    /// them must have the same number of samples.
+    template <typename SampleType>
+    using StemBuffers = std::array<juce::AudioBuffer<SampleType>*, NUM_STEMS>;
+
+    [[nodiscard]] static Stem getStem (const Accent accent) noexcept
+    {
+        switch (accent)
+        {
+            case Accent::downbeat:
+                return Stem::downbeat;
+            case Accent::subdivision:
+                return Stem::subdivision;
+            case Accent::strong:
+            case Accent::beat:
+            case Accent::silent:
+                break;
+        }
+
+        return Stem::beat;
+    }
 
-        // Be able to handle enough beat positions per buffer without reallocation in audio callback.
-        static constexpr int MAX_BEATS_IN_AUDIO_BUFFER_PREDICTION = 2048;
-        beats.reserve (MAX_BEATS_IN_AUDIO_BUFFER_PREDICTION);
+    Metronome()
+        : clickSampleLibrary (ClickSampleLibrary::getInstance()),
+          builtInClickSamples (clickSampleLibrary->getClickSamples (clickSampleLibrary->getOriginalSampleRate())),
+          clickSamples (builtInClickSamples.get())
+    {
     }
 
     void prepareToPlay (const double sampleRateIn, const int samplesPerBlock)
     {
         sampleRate = sampleRateIn;
+        builtInClickSamples = clickSampleLibrary->getClickSamples (sampleRate); // voices playing the old set are reset below
+        clickSamples = builtInClickSamples.get(); // a kit set with `setClickSamples()` was built for the old rate
 
-        mixer.removeAllInputs();
-
-        downbeatAudio->prepareToPlay (samplesPerBlock, sampleRate);
-        beatAudio->prepareToPlay (samplesPerBlock, sampleRate);
-        mixer.prepareToPlay (samplesPerBlock, sampleRate);
-        mixer.addInputSource (downbeatAudio.get(), false);
-        mixer.addInputSource (beatAudio.get(), false);
+        // Room for a beat on every sample of the largest block, so scheduling never reallocates on the audio thread
+        beats.reserve (static_cast<size_t> (std::max (samplesPerBlock, 0)) + 1);
 
+        updateBeatLength();
+        prepareVoices();
+        for (auto& synth : synths)
+            synth.prepare (sampleRate);
+        midiOutput.prepare (sampleRate);
         reset();
     }
 
     void reset()
     {
-        countSampleInCurrentBeat = 0;
-
-        // Prepare first downbeat
-        countBeatInMeasure = 0;
+        // Prepare first downbeat at the very start of the next block
+        beatClock.reset();
+        patternCursor = 0;
         beats.clear();
-        beats.push_back ({ 0, true });
+        midiOutput.resetClock();
+
+        if (isFollowingTempoMap())
+            seekTempoMap (0);
 
-        // Set audio clips to be "stopped" until its read position is set to 0 the first time.
-        downbeatAudio->setNextReadPosition (downbeatAudio->getTotalLength() - 1);
-        beatAudio->setNextReadPosition (beatAudio->getTotalLength() - 1);
+        // Stop any clicks still ringing
+        stopClicks();
     }
 
     void setBPM (const double bpmNew)
@@ -55,10 +110,10 @@ public:
         {
             bpm = bpmNew;
 
-            /// When user changes BPM, keep counting, but never surpass the current beat length, which could cause BAD_ACCESS in `process()`.
-            ///     Alternatively, we could set `countSampleInCurrentBeat = 0`, but this causes the beat to
+            /// When user changes BPM, keep counting, but never surpass the new beat length.
+            ///     Alternatively, we could restart the clock, but this causes the beat to
             ///     hit every time a new BPM change is detected, so when user drags slider, it sounds horrible.
-            countSampleInCurrentBeat = std::min (countSampleInCurrentBeat, getSamplesPerBeat());
+            updateBeatLength();
         }
     }
 
@@ -67,93 +122,568 @@ public:
         if (timeSignature != timeSignatureNew)
         {
             timeSignature = timeSignatureNew;
-            countBeatInMeasure = std::min (countBeatInMeasure, timeSignature.beatsPerMeasure - 1);
+            updatePattern();
+        }
+    }
+
+    /// Sets the subdivisions and accents played in each measure.
+    void setRhythmPattern (const RhythmPattern& rhythmPatternNew)
+    {
+        if (rhythmPattern != rhythmPatternNew)
+        {
+            rhythmPattern = rhythmPatternNew;
+            updatePattern();
         }
     }
 
-    void process (juce::AudioBuffer<float>& buffer) noexcept
+    /// Plays the tempo and time signature changes of `tempoMap`, starting from its first bar at the start of the next
+    /// block. While a map is set, it overrides `setBPM()` and `setTimeSignature()`. Pass an empty map to go back to them.
+    void setTempoMap (const TempoMap& tempoMapNew) noexcept
     {
-        const int numSamplesInBuffer = buffer.getNumSamples();
+        tempoMap = tempoMapNew;
+        beatClock.reset();
+        patternCursor = 0;
+        midiOutput.resetClock();
 
-        // Find beat positions in current block
-        const int samplesPerBeat = getSamplesPerBeat();
-        for (int offset = std::max (samplesPerBeat - countSampleInCurrentBeat, 0); offset < numSamplesInBuffer; offset += samplesPerBeat)
+        if (tempoMap.isEmpty())
+        {
+            pattern.compile (timeSignature, rhythmPattern);
+            updateBeatLength();
+        }
+        else if (sampleRate > 0)
         {
-            ++countBeatInMeasure %= timeSignature.beatsPerMeasure; // consider using if statement instead of modulo for speed
-            beats.push_back ({ offset, countBeatInMeasure == 0 });
+            tempoMap.prepare (sampleRate, pattern.getPulsesPerBeat());
+            seekTempoMap (0);
         }
+    }
 
-        // If no beat positions in this block, keep counting and output any audio that may be remaining in the beat samples
-        if (beats.empty())
+    /// Chooses between the embedded click samples and synthesised clicks for the next beats.
+    /// Clicks already sounding ring out with the sound they started with.
+    void setClickSound (const ClickSound clickSoundNew) noexcept { clickSound = clickSoundNew; }
+
+    /// Plays the next sample clicks from `newSamples`, e.g. a user's kit, or from the embedded clicks if it's null.
+    /// Real-time safe: it just swaps a pointer. Clicks already ringing finish from the old set, so the caller must keep
+    /// a set alive for its `longestClickLength` samples after switching away from it. `newSamples` must have been built
+    /// for the sample rate passed to `prepareToPlay()`, which switches back to the embedded clicks.
+    void setClickSamples (const ClickSampleLibrary::ClickSampleSet* newSamples) noexcept
+    {
+        jassert (newSamples == nullptr || juce::approximatelyEqual (newSamples->sampleRate, sampleRate));
+        clickSamples = newSamples != nullptr ? newSamples : builtInClickSamples.get();
+    }
+
+    /// The sample clicks new beats start from.
+    [[nodiscard]] const ClickSampleLibrary::ClickSampleSet& getClickSamples() const noexcept { return *clickSamples; }
+
+    /// Chooses what MIDI the `process()` calls write: a note per click and/or MIDI clock. Off by default.
+    void setMidiOutput (const MidiClickOutput::Settings& settings) noexcept { midiOutput.setSettings (settings); }
+
+    /// Ends any MIDI notes still on and stops the MIDI clock, at the start of `midi`'s block of `numSamples`. Call it in
+    /// place of `process()` for blocks where the metronome is stopped, so receivers stop with it.
+    void stopMidi (juce::MidiBuffer& midi, const int numSamples) noexcept
+    {
+        midiOutput.stop (midi, 0);
+        midiOutput.finishBlock (midi, numSamples);
+    }
+
+    /// Plays the clicks `numSamples` ahead of the MIDI, to make up for the audio output latency.
+    ///
+    /// Clicks are heard once they've made it through the output buffers, while MIDI goes out to other devices almost
+    /// straight away. The schedulers work exactly as before and the clicks render straight away, but the MIDI is held
+    /// back by `numSamples`, so both arrive together. When synced to a host, report the same amount as the plugin's
+    /// latency, and the host's delay compensation plays the clicks that much earlier against its timeline, which puts
+    /// the MIDI back on the grid and the clicks ahead of it. Either way, no smaller buffers or extra CPU are needed.
+    void setLookAhead (const int numSamples) noexcept { midiOutput.setDelay (numSamples); }
+
+    /// Applies all of `snapshot`'s settings at once, e.g. a preset, so a new tempo and meter start on the same pulse.
+    /// Uses the accent pattern the snapshot compiled off the audio thread, and works the beat length out once. Real-time
+    /// safe. Following the host is up to the caller.
+    void applySnapshot (const MetronomeSnapshot& snapshot) noexcept
+    {
+        const auto& settings = snapshot.settings;
+        setClickSound (settings.clickSound);
+        setMidiOutput (settings.midiOutput);
+        setLookAhead (static_cast<int> (std::lround (settings.lookAheadSeconds * sampleRate)));
+
+        if (! juce::exactlyEqual (bpm, settings.bpm) || timeSignature != settings.timeSignature || rhythmPattern != settings.rhythmPattern)
+        {
+            bpm = settings.bpm;
+            timeSignature = settings.timeSignature;
+            rhythmPattern = settings.rhythmPattern;
+            pattern = snapshot.pattern;
+            updateBeatLength();
+
+            if (patternCursor >= pattern.getNumPulses())
+                patternCursor = 0;
+        }
+    }
+
+    /// Changes the synthesised click sounds, which can be tuned at any time.
+    void setSynthSounds (const ClickSynth::Sound& downbeat, const ClickSynth::Sound& beat) noexcept
+    {
+        for (auto& synth : synths)
+            synth.setSounds (downbeat, beat);
+    }
+
+    /// Jumps the timeline to `samplePosition` samples after the first downbeat, as if the metronome had played there at
+    /// its current BPM and time signature (or along its tempo map) since `reset()`. Clicks that would still be ringing from before that point
+    /// aren't restored, so render `getLongestClickLength()` samples of pre-roll first if you need them.
+    void seek (const juce::int64 samplePosition) noexcept
+    {
+        stopClicks();
+        beats.clear();
+        midiOutput.resetClock(); // the clock picks up again from the next pulse
+
+        if (isFollowingTempoMap())
+        {
+            seekTempoMap (samplePosition);
+            return;
+        }
+
+        beatClock.seek (samplePosition);
+        patternCursor = static_cast<int> (beatClock.getNextBeatIndex() % pattern.getNumPulses());
+    }
+
+    /// Length in samples of the longest click, i.e. how long a click can keep sounding after its beat.
+    [[nodiscard]] int getLongestClickLength() const noexcept
+    {
+        return std::max (clickSamples->longestClickLength, synths.front().getLongestSoundLength());
+    }
+
+    /// Number of clicks started by the last block rendered.
+    [[nodiscard]] int getNumBeatsInLastBlock() const noexcept { return static_cast<int> (beats.size()); }
+
+    /// The clicks started by the last block rendered, in order, e.g. to show them in a beat indicator.
+    [[nodiscard]] const std::vector<Beat>& getBeatsInLastBlock() const noexcept { return beats; }
+
+    /// Number of clicks still sounding at the end of the last block rendered.
+    [[nodiscard]] int getNumActiveVoices() const noexcept
+    {
+        int numActiveVoices = 0;
+        for (size_t pool = 0; pool < voices.size(); ++pool)
+            numActiveVoices += voices[pool].getNumActiveVoices() + synths[pool].getNumActiveVoices();
+        return numActiveVoices;
+    }
+
+    /// Renders the next block of clicks using the metronome's own BPM and time signature, or its tempo map if it has one.
+    /// If `midi` isn't null, the MIDI chosen with `setMidiOutput()` is added to it, on the same samples as the clicks.
+    /// The buffer can be float or double, and is rendered to directly either way.
+    template <typename SampleType>
+    void process (juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer* midi = nullptr) noexcept
+    {
+        process (StemBuffers<SampleType> { &buffer, &buffer, &buffer }, midi);
+    }
+
+    /// Like `process()`, but renders each stem straight into its own buffer, e.g. a separate output bus of the host's
+    /// buffer, with no mixing or copying afterwards.
+    template <typename SampleType>
+    void process (const StemBuffers<SampleType>& outputs, juce::MidiBuffer* midi = nullptr) noexcept
+    {
+        const int numSamplesInBuffer = outputs.front()->getNumSamples();
+        midiBuffer = midi;
+        beats.clear();
+
+        if (isFollowingTempoMap())
+        {
+            scheduleTempoMapBeats (numSamplesInBuffer);
+            renderBeats (outputs);
+            return;
+        }
+
+        // Find beat positions in current block. The beat clock ticks once per pulse of the pattern (i.e. per
+        // subdivision), and the accent of each pulse is looked up from the precompiled pattern table.
+        // Each position comes from the beat clock's exact fractional timeline and is rounded on its own, so rounding
+        // never accumulates into drift. This is one multiply-add per pulse: no per-sample work and no division.
+        for (double position = beatClock.getNextBeatPosition(); BeatClock::isInBlock (position, numSamplesInBuffer); position = beatClock.advanceToNextBeat())
+        {
+            startMidiPulse (position, beatClock.getSamplesPerBeat(), getQuartersPerPulse (timeSignature), patternCursor == 0);
+            scheduleBeat (BeatClock::toSampleIndex (position), patternCursor, BeatClock::getSubSampleOffset (position));
+            if (++patternCursor == pattern.getNumPulses())
+                patternCursor = 0;
+        }
+        beatClock.advanceBy (numSamplesInBuffer);
+
+        renderBeats (outputs);
+    }
+
+    /// Renders the next block of clicks locked to the host's transport.
+    ///
+    /// Beat positions are derived from the playhead's PPQ position and tempo every block, rather than from our own
+    /// clock, so transport jumps, tempo changes and loop wraps can never leave the click out of step with the grid.
+    /// JUCE reports the transport once per block, so a tempo change or locate takes effect from the block it's
+    /// reported in. A loop wrap within the block is handled by splitting the block at the loop end.
+    /// When the host isn't playing, no new beats are scheduled but clicks already sounding ring out.
+    /// If `midi` isn't null, the MIDI clock starts and stops with the host's transport, with the song position it starts from.
+    template <typename SampleType>
+    void processHostSynced (juce::AudioBuffer<SampleType>& buffer, const juce::AudioPlayHead::PositionInfo& position, juce::MidiBuffer* midi = nullptr) noexcept
+    {
+        processHostSynced (StemBuffers<SampleType> { &buffer, &buffer, &buffer }, position, midi);
+    }
+
+    /// Like `processHostSynced()`, but renders each stem into its own buffer, the same as the stems version of `process()`.
+    template <typename SampleType>
+    void processHostSynced (const StemBuffers<SampleType>& outputs, const juce::AudioPlayHead::PositionInfo& position, juce::MidiBuffer* midi = nullptr) noexcept
+    {
+        const int numSamplesInBuffer = outputs.front()->getNumSamples();
+        const auto ppqPosition = position.getPpqPosition();
+        const auto hostBpm = position.getBpm();
+        midiBuffer = midi;
+        beats.clear();
+
+        if (midiBuffer != nullptr && ! position.getIsPlaying())
+            midiOutput.stop (*midiBuffer, 0);
+
+        if (position.getIsPlaying() && ppqPosition.hasValue() && hostBpm.hasValue() && *hostBpm > 0.0 && sampleRate > 0.0)
+        {
+            if (midiBuffer != nullptr)
+                midiOutput.startClockAt (*midiBuffer, 0, *ppqPosition);
+
+            if (const auto hostTimeSignature = position.getTimeSignature())
+                setTimeSignature ({ { hostTimeSignature->numerator }, { hostTimeSignature->denominator } });
+            setBPM (*hostBpm);
+
+            const double quartersPerSample = *hostBpm / (60.0 * sampleRate);
+            const double barAnchor = position.getPpqPositionOfLastBarStart().orFallback (0.0);
+
+            double segmentStartPpq = *ppqPosition;
+            int segmentStart = 0;
+
+            if (const auto loopPoints = position.getLoopPoints(); position.getIsLooping() && loopPoints.hasValue())
+            {
+                const double samplesUntilLoopEnd = (loopPoints->ppqEnd - segmentStartPpq) / quartersPerSample;
+                if (loopPoints->ppqEnd > loopPoints->ppqStart && samplesUntilLoopEnd > 0.0 && samplesUntilLoopEnd < numSamplesInBuffer)
+                {
+                    const int loopEndSample = BeatClock::toSampleIndex (samplesUntilLoopEnd);
+                    scheduleHostBeats (segmentStartPpq, segmentStart, loopEndSample, quartersPerSample, barAnchor);
+
+                    // Carry the fraction of a sample the loop end was rounded by over to the loop start
+                    segmentStartPpq = loopPoints->ppqStart + (loopEndSample - samplesUntilLoopEnd) * quartersPerSample;
+                    segmentStart = loopEndSample;
+                }
+            }
+
+            scheduleHostBeats (segmentStartPpq, segmentStart, numSamplesInBuffer, quartersPerSample, barAnchor);
+        }
+
+        renderBeats (outputs);
+    }
+
+private:
+    /// Finds the beats in `[startSample, endSample)` of the block, where `startSample` is at `startPpq` quarter notes
+    /// on the host timeline. Bars are assumed to line up with `barAnchor`, which is the host's last bar start.
+    void scheduleHostBeats (const double startPpq, const int startSample, const int endSample, const double quartersPerSample, const double barAnchor) noexcept
+    {
+        if (endSample <= startSample)
+            return;
+
+        // Hosts round their PPQ positions, so give block edges a little slack in both directions.
+        // The same slack is used at both ends of the range, so a beat on the boundary is neither doubled nor dropped.
+        static constexpr double BEAT_EDGE_TOLERANCE = 1.0e-9;
+
+        // Pulses are the pattern's subdivisions of each beat
+        const double quartersPerPulse = getQuartersPerPulse (timeSignature);
+        const double quartersPerBar = quartersPerPulse * pattern.getNumPulses();
+        const double barStart = barAnchor + std::floor ((startPpq - barAnchor) / quartersPerBar) * quartersPerBar;
+        const double endPpq = startPpq + (endSample - startSample) * quartersPerSample;
+        const double lastPulsePpq = endPpq - BEAT_EDGE_TOLERANCE * quartersPerPulse;
+        const double samplesPerQuarter = 1.0 / quartersPerSample;
+
+        int pulseInBar = static_cast<int> (std::ceil ((startPpq - barStart) / quartersPerPulse - BEAT_EDGE_TOLERANCE));
+        double pulsePpq = barStart + pulseInBar * quartersPerPulse;
+        if (pulseInBar >= pattern.getNumPulses())
+            pulseInBar = 0;
+
+        // The host may have jumped, so pick up the MIDI clock from the pulse we're in, rather than the last one we played
+        if (midiBuffer != nullptr)
+        {
+            const double previousPulsePpq = pulsePpq - quartersPerPulse;
+            const double previousPulseTicks = previousPulsePpq * MidiClickOutput::CLOCK_TICKS_PER_QUARTER_NOTE;
+            midiOutput.locatePulse (startSample + (previousPulsePpq - startPpq) * samplesPerQuarter,
+                                    quartersPerPulse * samplesPerQuarter,
+                                    quartersPerPulse * MidiClickOutput::CLOCK_TICKS_PER_QUARTER_NOTE,
+                                    previousPulseTicks - std::floor (previousPulseTicks),
+                                    startSample - 0.5);
+        }
+
+        for (; pulsePpq < lastPulsePpq; pulsePpq += quartersPerPulse)
+        {
+            const double position = (pulsePpq - startPpq) * samplesPerQuarter;
+            startMidiPulse (startSample + position, quartersPerPulse * samplesPerQuarter, quartersPerPulse, pulseInBar == 0);
+
+            const int beatPosition = startSample + BeatClock::toSampleIndex (position);
+            if (beatPosition < endSample)
+                scheduleBeat (beatPosition, pulseInBar, BeatClock::getSubSampleOffset (position));
+            else // just inside the tolerance at the end of the range, so play it on the last sample
+                scheduleBeat (endSample - 1, pulseInBar, 0.5f);
+
+            if (++pulseInBar == pattern.getNumPulses())
+                pulseInBar = 0;
+        }
+
+        patternCursor = pulseInBar;
+
+        if (midiBuffer != nullptr)
+            midiOutput.addClockTicksUpTo (*midiBuffer, endSample);
+    }
+
+    /// Adds a beat to start in this block, playing `pulse` of the pattern. Never reallocates, so at absurd tempos with
+    /// more beats than samples in a block, the beats that don't fit in the capacity reserved in `prepareToPlay()` are dropped.
+    void scheduleBeat (const int samplePosition, const int pulse, const float subSampleOffset) noexcept
+    {
+        const int pulsesPerBeat = pattern.getPulsesPerBeat();
+        if (beats.size() < beats.capacity())
+            beats.push_back ({ samplePosition, pattern[pulse], subSampleOffset, pulse, pulsesPerBeat, pattern.getNumPulses() / pulsesPerBeat });
+    }
+
+    /// Finds the pulses of the tempo map in the next `numSamples` samples.
+    /// Each pulse's position is evaluated in closed form from its index within its segment, so the cost depends only
+    /// on the number of pulses in the block, never on its length, and ramps are exact to the sample at every pulse.
+    void scheduleTempoMapBeats (const int numSamples) noexcept
+    {
+        const auto blockStart = static_cast<double> (tempoMapPosition);
+
+        for (;;)
         {
-            /// Alternatively, we could increase `countSampleInCurrentBeat` like:
-            /// ```cpp
-            /// countSampleInCurrentBeat = (numSamplesInBuffer + countSampleInCurrentBeat) % samplesPerBeat;
-            /// ```
-            // But `%` modulo relies on division which is more computationally heavy.
-            // We can obtain the same result heuristically with this if statement, without division.
-            countSampleInCurrentBeat += numSamplesInBuffer;
+            if (tempoMapPulse.pulse == tempoMap.getSegment (tempoMapPulse.segment).numPulses)
+                tempoMapPulse = { tempoMapPulse.segment + 1, 0 };
+
+            const double position = tempoMap.getPulsePosition (tempoMapPulse.segment, tempoMapPulse.pulse) - blockStart;
+            if (! BeatClock::isInBlock (position, numSamples))
+                break;
+
+            // Segments start on a bar line, with a new time signature
+            if (tempoMapPulse.pulse == 0)
+                applyTempoMapSegment();
+
+            if (midiBuffer != nullptr)
+            {
+                const double pulseLength = tempoMap.getPulsePosition (tempoMapPulse.segment, tempoMapPulse.pulse + 1) - blockStart - position;
+                startMidiPulse (position, pulseLength, getQuartersPerPulse (tempoMap.getSegment (tempoMapPulse.segment).timeSignature), patternCursor == 0);
+            }
+
+            scheduleBeat (BeatClock::toSampleIndex (position), patternCursor, BeatClock::getSubSampleOffset (position));
+            if (++patternCursor == pattern.getNumPulses())
+                patternCursor = 0;
+            ++tempoMapPulse.pulse;
+        }
+
+        tempoMapPosition += numSamples;
+    }
+
+    /// Moves the tempo map to `samplePosition` samples after its start.
+    void seekTempoMap (const juce::int64 samplePosition) noexcept
+    {
+        tempoMapPosition = samplePosition;
+        tempoMapPulse = tempoMap.findPulseAt (samplePosition);
+        applyTempoMapSegment();
+        patternCursor = static_cast<int> (tempoMapPulse.pulse % pattern.getNumPulses());
+    }
+
+    /// Switches to the time signature of the current tempo map segment, starting from its downbeat.
+    void applyTempoMapSegment() noexcept
+    {
+        // `timeSignature` is left alone, ready for when the map is cleared
+        pattern.compile (tempoMap.getSegment (tempoMapPulse.segment).timeSignature, rhythmPattern);
+        patternCursor = 0;
+    }
+
+    [[nodiscard]] bool isFollowingTempoMap() const noexcept { return tempoMap.getNumSegments() > 0; }
 
-            const juce::AudioSourceChannelInfo info (&buffer, 0, numSamplesInBuffer);
-            mixer.getNextAudioBlock (info);
+    /// Renders the clicks for the beats scheduled in `beats`.
+    /// Mono and stereo get their own compiled kernels, so the channel loops are unrolled; other layouts, or outputs
+    /// with different channel counts, loop over the channels at run time.
+    template <typename SampleType>
+    void renderBeats (const StemBuffers<SampleType>& outputs) noexcept
+    {
+        // Stems sharing a buffer share the voices of the first of them, so a single output renders through one voice
+        // pool and one synth, just as it did before there were stems
+        int numChannels = outputs.front()->getNumChannels();
+        for (size_t stem = 0; stem < outputs.size(); ++stem)
+        {
+            jassert (outputs[stem]->getNumSamples() == outputs.front()->getNumSamples());
+            stemPools[stem] = static_cast<int> (std::find (outputs.begin(), outputs.end(), outputs[stem]) - outputs.begin());
+            if (outputs[stem]->getNumChannels() != numChannels)
+                numChannels = ClickSample::ANY_CHANNELS;
         }
-        else // If beat positions in this block, restart audio sample and start outputting it at the expected position
+
+        switch (numChannels)
         {
-            countSampleInCurrentBeat = numSamplesInBuffer - beats.back().samplePosition;
+            case 1:
+                renderBeats<1> (outputs);
+                break;
+            case 2:
+                renderBeats<2> (outputs);
+                break;
+            default:
+                renderBeats<ClickSample::ANY_CHANNELS> (outputs);
+                break;
+        }
+    }
+
+    template <int NumChannels, typename SampleType>
+    void renderBeats (const StemBuffers<SampleType>& outputs) noexcept
+    {
+        const int numSamplesInBuffer = outputs.front()->getNumSamples();
+
+        // Clicks replace whatever was in the buffers, the same as the `MixerAudioSource` we used to render through.
+        for (size_t stem = 0; stem < outputs.size(); ++stem)
+            if (stemPools[stem] == static_cast<int> (stem))
+                outputs[stem]->clear();
+
+        // If no beat positions in this block, output any audio that may be remaining in the beat samples
+        if (beats.empty())
+        {
+            renderClicks<NumChannels> (outputs, 0, numSamplesInBuffer);
+        }
+        else // If beat positions in this block, start a new click voice at each one, letting earlier clicks ring out
+        {
+            // Audio remaining from earlier beats plays up to the first beat in this block
+            renderClicks<NumChannels> (outputs, 0, beats.front().samplePosition);
 
             // Output click audio starting at each beat
             for (size_t beatIndex = 0; beatIndex < beats.size(); ++beatIndex)
             {
-                const auto& [beatPosition, isDownbeat] = beats[beatIndex];
+                const auto& beat = beats[beatIndex];
                 const int nextBeatPosition = beatIndex + 1 < beats.size() ? beats[beatIndex + 1].samplePosition : numSamplesInBuffer;
 
-                getAudioForBeat (isDownbeat)->setNextReadPosition (0); // restart playback position of specific audio clip
+                startClick (beat.accent, beat.subSampleOffset);
+                if (midiBuffer != nullptr)
+                    midiOutput.addClick (*midiBuffer, beat.samplePosition, beat.accent);
 
-                const juce::AudioSourceChannelInfo info (&buffer, beatPosition, nextBeatPosition - beatPosition);
-                mixer.getNextAudioBlock (info);
+                renderClicks<NumChannels> (outputs, beat.samplePosition, nextBeatPosition - beat.samplePosition);
             }
         }
 
-        beats.clear();
+        if (midiBuffer != nullptr)
+            midiOutput.finishBlock (*midiBuffer, numSamplesInBuffer);
+        else
+            midiOutput.resetClock(); // its pulse would go stale without the block to move it on
+        midiBuffer = nullptr;
     }
 
-private:
-    void loadAudioSamples()
+    /// Tells the MIDI output a pulse of `quartersPerPulse` quarter notes starts at `position`, for its clock ticks.
+    void startMidiPulse (const double position, const double lengthInSamples, const double quartersPerPulse, const bool isDownbeat) noexcept
+    {
+        if (midiBuffer != nullptr)
+            midiOutput.startPulse (*midiBuffer, position, lengthInSamples, quartersPerPulse * MidiClickOutput::CLOCK_TICKS_PER_QUARTER_NOTE, isDownbeat);
+    }
+
+    [[nodiscard]] double getQuartersPerPulse (const TimeSignature& signature) const noexcept { return 4.0 / signature.denominator / pattern.getPulsesPerBeat(); }
+
+    /// Starts a click for `accent`, `subSampleOffset` samples after the sample it's rendered from.
+    /// The sample clicks pick the nearest precomputed phase, and the synth starts its oscillators part way into the
+    /// click, so neither does any interpolation while rendering.
+    void startClick (const Accent accent, const float subSampleOffset) noexcept
     {
-        juce::AudioFormatManager formatManager;
-        formatManager.registerBasicFormats();
+        if (accent == Accent::silent)
+            return;
+
+        // Downbeats and group accents use the downbeat sound, with group accents and subdivisions played quieter,
+        // unless the sample kit has sounds of their own for them
+        const auto pool = static_cast<size_t> (stemPools[static_cast<size_t> (getStem (accent))]);
 
-        auto makeReaderSource = [&formatManager] (const char* bytes, const int size)
+        if (clickSound == ClickSound::synth)
+        {
+            synths[pool].start (accent == Accent::downbeat || accent == Accent::strong, getAccentGain (accent), subSampleOffset);
+        }
+        else
         {
-            auto* reader = formatManager.createReaderFor (std::make_unique<juce::MemoryInputStream> (bytes, static_cast<size_t> (size), false));
-            // TODO: Handle audio file not found instead of crashing.
-            jassert(reader != nullptr);
-            return std::make_unique<juce::AudioFormatReaderSource> (reader, true);
-        };
+            const auto [sample, gain] = clickSamples->getClick (accent, subSampleOffset);
+            voices[pool].start (sample, gain);
+        }
+    }
 
-        downbeatAudio = makeReaderSource (BinaryData::clickdownbeat_wav, BinaryData::clickdownbeat_wavSize);
-        beatAudio = makeReaderSource (BinaryData::clickbeat_wav, BinaryData::clickbeat_wavSize);
+    /// Mixes every click still sounding into `numSamples` of the outputs, starting at `startSample`.
+    /// Both sources are rendered, so clicks ring out when the sound is switched, but each costs nothing when silent, as
+    /// do the pools of stems sharing another stem's output.
+    template <int NumChannels, typename SampleType>
+    void renderClicks (const StemBuffers<SampleType>& outputs, const int startSample, const int numSamples) noexcept
+    {
+        for (size_t pool = 0; pool < voices.size(); ++pool)
+        {
+            voices[pool].render<NumChannels> (*outputs[pool], startSample, numSamples);
+            synths[pool].render<NumChannels> (*outputs[pool], startSample, numSamples);
+        }
     }
 
-    [[nodiscard]] int getSamplesPerBeat() const { return juce::roundToInt (60.0 / bpm * (4.0 / timeSignature.denominator) * sampleRate); }
-    std::unique_ptr<juce::AudioFormatReaderSource>& getAudioForBeat (const bool isDownbeat) { return isDownbeat ? downbeatAudio : beatAudio; }
+    void stopClicks() noexcept
+    {
+        for (size_t pool = 0; pool < voices.size(); ++pool)
+        {
+            voices[pool].reset();
+            synths[pool].reset();
+        }
+    }
+
+    /// Allocates each stem's voice pool up front, with room for a click of the longest length a kit can have to ring out
+    /// at the fastest beat the editor allows (1000 BPM in 64th notes), but never more than `MAX_VOICES`. A 2 second kit
+    /// click hits that cap at well under 1000 BPM, so at fast tempos, especially with subdivisions, a new click steals the
+    /// voice that has played longest, cutting off the quiet end of its tail.
+    void prepareVoices()
+    {
+        static constexpr double FASTEST_BPM = 1000.0;
+        static constexpr int SHORTEST_NOTE_TYPE = 64;
+        static constexpr int MAX_VOICES = 64;
+
+        const double shortestSamplesPerBeat = std::max (60.0 / FASTEST_BPM * (4.0 / SHORTEST_NOTE_TYPE) * sampleRate, 1.0);
+        const int longestSample = static_cast<int> (std::ceil (ClickSample::MAX_LENGTH_SECONDS * sampleRate));
+        const int voicesNeeded = static_cast<int> (std::ceil (longestSample / shortestSamplesPerBeat)) + 1;
+
+        for (auto& pool : voices)
+            pool.prepare (std::clamp (voicesNeeded, 2, MAX_VOICES));
+    }
+
+    /// Recompiles the pattern table for the current time signature and rhythm pattern. Only runs when either changes.
+    void updatePattern() noexcept
+    {
+        pattern.compile (timeSignature, rhythmPattern);
+        updateBeatLength(); // the denominator and subdivisions change the pulse length too
+
+        if (patternCursor >= pattern.getNumPulses())
+            patternCursor = 0;
+    }
+
+    void updateBeatLength() noexcept
+    {
+        if (sampleRate <= 0)
+            return;
+
+        beatClock.setSamplesPerBeat (getSamplesPerBeat() / pattern.getPulsesPerBeat());
+
+        // The map's pulse lengths depend on the sample rate and subdivisions too. Recompile it, and carry on from the
+        // same point on the timeline in the new pulses.
+        if (! tempoMap.isEmpty())
+        {
+            tempoMap.prepare (sampleRate, pattern.getPulsesPerBeat());
+            seekTempoMap (tempoMapPosition);
+        }
+    }
+
+    [[nodiscard]] double getSamplesPerBeat() const { return 60.0 / bpm * (4.0 / timeSignature.denominator) * sampleRate; }
 
     double bpm = 120;
 
     TimeSignature timeSignature = { { 4 }, { 4 } };
 
     double sampleRate = 0;
-    int countSampleInCurrentBeat = 0; // starts counting at 1, so 1 means 1 sample
-    int countBeatInMeasure = 0; // starts counting at 0, so 0 is the downbeat
+    RhythmPattern rhythmPattern;
+    AccentPattern pattern;
+    BeatClock beatClock; // ticks once per pulse of the pattern
+    int patternCursor = 0; // index of the next pulse in `pattern`, starting at 0, so 0 is the downbeat
 
-    juce::MixerAudioSource mixer;
-    std::unique_ptr<juce::AudioFormatReaderSource> downbeatAudio;
-    std::unique_ptr<juce::AudioFormatReaderSource> beatAudio;
+    TempoMap tempoMap; // overrides `bpm` and `timeSignature` when not empty
+    TempoMap::PulseIndex tempoMapPulse; // next pulse of the tempo map
+    juce::int64 tempoMapPosition = 0; // samples since the start of the tempo map at the start of the next block
 
-    struct Beat
-    {
-        int samplePosition = 0;
-        bool isDownbeat = false;
-    };
-    std::vector<Beat> beats;
+    // Shared with every other instance, so the clicks are decoded and resampled once per process
+    std::shared_ptr<ClickSampleLibrary> clickSampleLibrary;
+    std::shared_ptr<const ClickSampleLibrary::ClickSampleSet> builtInClickSamples; // the set for the current sample rate
+    const ClickSampleLibrary::ClickSampleSet* clickSamples = nullptr; // the set clicks start from, never null
+    std::array<ClickVoicePool, NUM_STEMS> voices; // one pool per stem, of which only the first is used for a single output
+    std::array<ClickSynth, NUM_STEMS> synths; // likewise
+    std::array<int, NUM_STEMS> stemPools {}; // the voices and synth each stem's clicks start in, from the last block's outputs
+    ClickSound clickSound = ClickSound::samples;
+    MidiClickOutput midiOutput;
+    juce::MidiBuffer* midiBuffer = nullptr; // where the block being processed writes its MIDI, if anywhere
+
+    std::vector<Beat> beats; // scheduled for the block being processed, and kept until the next one starts
 };
@@ -0,0 +1,298 @@
+#pragma once
+
+#include "AccentPattern.h"
+#include "BeatClock.h"
+#include "ClickSampleLibrary.h"
+#include "ClickVoicePool.h"
+#include "TimeSignature.h"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+/// Many independent metronomes in one engine, e.g. for polyrhythms, a click feed per musician, or cue tracks.
+///
+/// N separate `Metronome`s cost N schedulers, N voice pools and N passes over the buffer, even when most of them have
+/// nothing to play in a block. The bank keeps every track's clock in structure-of-arrays form instead, so finding the
+/// next pulse of all tracks is one branch-free pass of a multiply-add per track, which the compiler vectorises. Only
+/// tracks with a pulse in the block are visited after that, and every click plays from one shared voice pool and the
+/// process-wide click samples, so the cost of a block follows the clicks sounding in it rather than the number of tracks.
+///
+/// Each track has its own tempo, time signature and rhythm pattern, with the same drift-free timing as `BeatClock`.
+/// Like `Metronome`, nothing here is thread-safe, so change tracks between blocks, e.g. from a command queue.
+class MetronomeBank
+{
+public:
+    static constexpr int MAX_TRACKS = 64;
+
+    /// Where `process()` plays each track.
+    enum class Output
+    {
+        summed, // every track into every channel
+        perTrack // track n into channel n only, and tracks without a channel are muted
+    };
+
+    MetronomeBank()
+        : clickSampleLibrary (ClickSampleLibrary::getInstance()),
+          clickSamples (clickSampleLibrary->getClickSamples (clickSampleLibrary->getOriginalSampleRate()))
+    {
+    }
+
+    void prepareToPlay (const double sampleRateIn, const int samplesPerBlock)
+    {
+        sampleRate = sampleRateIn;
+        clickSamples = clickSampleLibrary->getClickSamples (sampleRate); // voices playing the old set are reset below
+
+        // Room for a beat on every sample of the largest block, plus the first beat of every track
+        beats.reserve (static_cast<size_t> (std::max (samplesPerBlock, 0)) + MAX_TRACKS);
+        voices.prepare (MAX_VOICES);
+
+        for (int track = 0; track < numTracks; ++track)
+            updatePulseLength (track);
+
+        reset();
+    }
+
+    /// Restarts every track on its downbeat at the start of the next block, and stops any clicks still ringing.
+    void reset() noexcept
+    {
+        for (int track = 0; track < numTracks; ++track)
+            resetTrack (track);
+
+        beats.clear();
+        voices.reset();
+    }
+
+    /// Adds a track that starts on its downbeat at the start of the next block. Returns its index, or -1 if the bank is full.
+    int addTrack (const double bpm, const TimeSignature timeSignature, const RhythmPattern& rhythmPattern = {}) noexcept
+    {
+        if (numTracks == MAX_TRACKS)
+            return -1;
+
+        const int track = numTracks++;
+        bpms[idx (track)] = bpm;
+        timeSignatures[idx (track)] = timeSignature;
+        rhythmPatterns[idx (track)] = rhythmPattern;
+        gains[idx (track)] = 1.0f;
+        samplesPerPulse[idx (track)] = 0.0;
+
+        patterns[idx (track)].compile (timeSignature, rhythmPattern);
+        resetTrack (track);
+        updatePulseLength (track);
+        return track;
+    }
+
+    /// Removes every track. Clicks already sounding are stopped too, as their tracks and channels are gone.
+    void removeAllTracks() noexcept
+    {
+        numTracks = 0;
+        voices.reset();
+    }
+
+    [[nodiscard]] int getNumTracks() const noexcept { return numTracks; }
+
+    /// Changes a track's tempo while it keeps counting, the same way as `Metronome::setBPM()`.
+    void setBPM (const int track, const double bpm) noexcept
+    {
+        jassert (juce::isPositiveAndBelow (track, numTracks));
+        if (! juce::exactlyEqual (bpms[idx (track)], bpm))
+        {
+            bpms[idx (track)] = bpm;
+            updatePulseLength (track);
+        }
+    }
+
+    void setTimeSignature (const int track, const TimeSignature timeSignature) noexcept
+    {
+        jassert (juce::isPositiveAndBelow (track, numTracks));
+        if (timeSignatures[idx (track)] != timeSignature)
+        {
+            timeSignatures[idx (track)] = timeSignature;
+            updatePattern (track);
+        }
+    }
+
+    void setRhythmPattern (const int track, const RhythmPattern& rhythmPattern) noexcept
+    {
+        jassert (juce::isPositiveAndBelow (track, numTracks));
+        if (rhythmPatterns[idx (track)] != rhythmPattern)
+        {
+            rhythmPatterns[idx (track)] = rhythmPattern;
+            updatePattern (track);
+        }
+    }
+
+    /// Scales a track's clicks, e.g. 0 to mute it without losing its place.
+    void setGain (const int track, const float gain) noexcept
+    {
+        jassert (juce::isPositiveAndBelow (track, numTracks));
+        gains[idx (track)] = gain;
+    }
+
+    /// Number of clicks still sounding at the end of the last block rendered, over all tracks.
+    [[nodiscard]] int getNumActiveVoices() const noexcept { return voices.getNumActiveVoices(); }
+
+    /// Renders the next block of every track, replacing whatever was in the buffer.
+    void process (juce::AudioBuffer<float>& buffer, const Output output = Output::summed) noexcept
+    {
+        const int numSamplesInBuffer = buffer.getNumSamples();
+        buffer.clear();
+
+        if (sampleRate <= 0)
+            return;
+
+        scheduleBeats (numSamplesInBuffer);
+
+        // Clicks from different tracks interleave, so play them in time order
+        std::sort (beats.begin(), beats.end(), [] (const Beat& a, const Beat& b) { return a.samplePosition < b.samplePosition; });
+
+        if (beats.empty())
+        {
+            voices.render (buffer, 0, numSamplesInBuffer);
+        }
+        else
+        {
+            voices.render (buffer, 0, beats.front().samplePosition);
+
+            for (size_t beatIndex = 0; beatIndex < beats.size(); ++beatIndex)
+            {
+                const auto& beat = beats[beatIndex];
+                const int nextBeatPosition = beatIndex + 1 < beats.size() ? beats[beatIndex + 1].samplePosition : numSamplesInBuffer;
+
+                startClick (beat, output, buffer.getNumChannels());
+                voices.render (buffer, beat.samplePosition, nextBeatPosition - beat.samplePosition);
+            }
+        }
+
+        beats.clear();
+    }
+
+private:
+    // Enough for every track to ring a few clicks over each other. Beyond that the oldest click is stolen.
+    static constexpr int MAX_VOICES = 4 * MAX_TRACKS;
+
+    struct Beat
+    {
+        int samplePosition = 0;
+        int track = 0;
+        Accent accent = Accent::beat;
+        float subSampleOffset = 0.0f; // where the beat ideally falls, from -0.5 to 0.5 samples after `samplePosition`
+    };
+
+    [[nodiscard]] static size_t idx (const int track) noexcept { return static_cast<size_t> (track); }
+
+    /// Finds the pulses of every track in the next `numSamples` samples.
+    void scheduleBeats (const int numSamples) noexcept
+    {
+        // The next pulse of each track, as `BeatClock::getNextBeatPosition()` works it out. No branches, so the
+        // compiler vectorises it over all the tracks at once.
+        for (size_t track = 0; track < static_cast<size_t> (numTracks); ++track)
+            nextPulsePositions[track] = anchorPositions[track] + pulsesSinceAnchor[track] * samplesPerPulse[track] - samplesSinceAnchor[track];
+
+        // At ordinary tempos most tracks have no pulse in a block, so this just skips over them
+        for (int track = 0; track < numTracks; ++track)
+        {
+            const auto t = idx (track);
+            for (double position = nextPulsePositions[t]; BeatClock::isInBlock (position, numSamples);)
+            {
+                auto& cursor = patternCursors[t];
+                scheduleBeat ({ BeatClock::toSampleIndex (position), track, patterns[t][cursor], BeatClock::getSubSampleOffset (position) });
+                if (++cursor == patterns[t].getNumPulses())
+                    cursor = 0;
+
+                pulsesSinceAnchor[t] += 1.0;
+                position = anchorPositions[t] + pulsesSinceAnchor[t] * samplesPerPulse[t] - samplesSinceAnchor[t];
+            }
+        }
+
+        for (size_t track = 0; track < static_cast<size_t> (numTracks); ++track)
+            samplesSinceAnchor[track] += numSamples;
+    }
+
+    /// Adds a beat to start in this block. Never reallocates, so beats beyond the capacity reserved in
+    /// `prepareToPlay()` are dropped.
+    void scheduleBeat (const Beat& beat) noexcept
+    {
+        if (beats.size() < beats.capacity())
+            beats.push_back (beat);
+    }
+
+    /// Starts the click for `beat`, picking the precomputed phase nearest its ideal position like `Metronome` does.
+    void startClick (const Beat& beat, const Output output, const int numChannels) noexcept
+    {
+        if (beat.accent == Accent::silent || (output == Output::perTrack && beat.track >= numChannels))
+            return;
+
+        const auto [sample, accentGain] = clickSamples->getClick (beat.accent, beat.subSampleOffset);
+        voices.start (sample, accentGain * gains[idx (beat.track)], output == Output::perTrack ? beat.track : ClickVoicePool::ALL_CHANNELS);
+    }
+
+    void resetTrack (const int track) noexcept
+    {
+        const auto t = idx (track);
+        anchorPositions[t] = 0.0;
+        pulsesSinceAnchor[t] = 0.0;
+        samplesSinceAnchor[t] = 0.0;
+        patternCursors[t] = 0;
+    }
+
+    void updatePattern (const int track) noexcept
+    {
+        const auto t = idx (track);
+        patterns[t].compile (timeSignatures[t], rhythmPatterns[t]);
+        updatePulseLength (track); // the denominator and subdivisions change the pulse length too
+
+        if (patternCursors[t] >= patterns[t].getNumPulses())
+            patternCursors[t] = 0;
+    }
+
+    /// Sets a track's pulse length from its tempo, time signature and subdivisions. Like
+    /// `BeatClock::setSamplesPerBeat()`, and with its `BeatClock::reanchor()`, the track keeps counting from its last
+    /// pulse but never waits longer than one new pulse.
+    void updatePulseLength (const int track) noexcept
+    {
+        if (sampleRate <= 0)
+            return;
+
+        const auto t = idx (track);
+        const double newSamplesPerPulse = 60.0 / bpms[t] * (4.0 / timeSignatures[t].denominator) * sampleRate / patterns[t].getPulsesPerBeat();
+        jassert (newSamplesPerPulse > 0.0);
+        if (juce::exactlyEqual (samplesPerPulse[t], newSamplesPerPulse))
+            return;
+
+        // Re-anchor on the last pulse played, if any, so further changes before the next pulse still count from it.
+        // The track keeps its place in its measure.
+        const bool hasPlayedAPulse = pulsesSinceAnchor[t] > 0.0;
+        const double nextPulsePosition = anchorPositions[t] + pulsesSinceAnchor[t] * samplesPerPulse[t] - samplesSinceAnchor[t];
+        const double firstPulsePosition = BeatClock::reanchor (nextPulsePosition, samplesPerPulse[t], newSamplesPerPulse, hasPlayedAPulse);
+        samplesPerPulse[t] = newSamplesPerPulse;
+        anchorPositions[t] = hasPlayedAPulse ? firstPulsePosition - newSamplesPerPulse : firstPulsePosition;
+        pulsesSinceAnchor[t] = hasPlayedAPulse ? 1.0 : 0.0;
+        samplesSinceAnchor[t] = 0.0;
+    }
+
+    double sampleRate = 0;
+    int numTracks = 0;
+
+    // Clock state, one element per track. Pulse n of a track ideally falls `anchor + n * samplesPerPulse` samples after
+    // its anchor. Counts are kept as doubles, which are exact up to 2^53, so the whole pass stays in one type.
+    std::array<double, MAX_TRACKS> anchorPositions {};
+    std::array<double, MAX_TRACKS> samplesPerPulse {};
+    std::array<double, MAX_TRACKS> pulsesSinceAnchor {};
+    std::array<double, MAX_TRACKS> samplesSinceAnchor {};
+    std::array<double, MAX_TRACKS> nextPulsePositions {}; // relative to the start of the current block
+
+    // Settings and accents, one element per track
+    std::array<double, MAX_TRACKS> bpms {};
+    std::array<TimeSignature, MAX_TRACKS> timeSignatures {};
+    std::array<RhythmPattern, MAX_TRACKS> rhythmPatterns {};
+    std::array<AccentPattern, MAX_TRACKS> patterns {};
+    std::array<int, MAX_TRACKS> patternCursors {}; // index of each track's next pulse in its pattern
+    std::array<float, MAX_TRACKS> gains {};
+
+    // Shared by every track, and with every other metronome in the process
+    std::shared_ptr<ClickSampleLibrary> clickSampleLibrary;
+    std::shared_ptr<const ClickSampleLibrary::ClickSampleSet> clickSamples;
+    ClickVoicePool voices;
+
+    std::vector<Beat> beats;
+};
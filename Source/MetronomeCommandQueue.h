@@ -0,0 +1,49 @@
+#pragma once
+
+#include "SpscQueue.h"
+#include <juce_core/juce_core.h>
+
+/// A change to the transport the message thread wants the audio thread to make. Settings such as the tempo travel
+/// separately, as whole `MetronomeSnapshot`s.
+struct MetronomeCommand
+{
+    enum class Type
+    {
+        start,
+        stop,
+        reset
+    };
+
+    Type type = Type::reset;
+};
+
+/// Bounded single-producer single-consumer FIFO for sending `MetronomeCommand`s to the audio thread.
+///
+/// Both ends are wait-free: `push()` and `drain()` only touch the preallocated ring and `juce::AbstractFifo`'s atomic
+/// indices, so the audio thread never blocks on (or gets priority-inverted by) the message thread, and never allocates.
+class MetronomeCommandQueue
+{
+public:
+    /// One producer at a time: callers on different threads must serialise their pushes, e.g. with a lock.
+    /// Returns false if the queue is full, in which case the command is dropped.
+    bool push (const MetronomeCommand& command) noexcept
+    {
+        if (commands.push (command))
+            return true;
+
+        jassertfalse; // The audio thread isn't draining the queue. Is the audio device running?
+        return false;
+    }
+
+    /// Audio thread only. Calls `apply` for every pending command, oldest first.
+    template <typename Function>
+    void drain (Function&& apply) noexcept
+    {
+        commands.drain (std::forward<Function> (apply));
+    }
+
+private:
+    static constexpr int CAPACITY = 256;
+
+    SpscQueue<MetronomeCommand, CAPACITY> commands;
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "AccentPattern.h"
+#include "ClickSound.h"
+#include "MidiClickOutput.h"
+#include "TimeSignature.h"
+#include <algorithm>
+#include <cmath>
+#include <juce_core/juce_core.h>
+#include <memory>
+#include <optional>
+
+/// Everything the user sets on the metronome, besides playing and stopping it and the click kit on disk.
+///
+/// The message thread changes it as a whole, and the audio thread only ever sees it inside a `MetronomeSnapshot`, so
+/// a tempo and time signature changed together are always heard together.
+struct MetronomeSettings
+{
+    static constexpr double MIN_BPM = 20.0;
+    static constexpr double MAX_BPM = 1000.0;
+    static constexpr double MAX_LOOK_AHEAD_SECONDS = 0.5;
+    static constexpr int FORMAT_VERSION = 1; // of `writeTo()`, for the plugin's saved state
+
+    double bpm = 120.0;
+    TimeSignature timeSignature = { { 4 }, { 4 } };
+    ClickSound clickSound = ClickSound::samples;
+    RhythmPattern rhythmPattern;
+    MidiClickOutput::Settings midiOutput;
+
+    // When true, the click follows the host's transport, tempo and time signature instead of the settings above.
+    bool syncToHost = false;
+
+    // How far the clicks play ahead of the MIDI, to make up for the audio output latency. When synced to the host,
+    // it's also reported as the plugin's latency, so the host's delay compensation lines the MIDI up with its timeline.
+    double lookAheadSeconds = 0.0;
+
+    bool operator== (const MetronomeSettings& other) const = default;
+
+    /// Writes the settings in a compact binary form: 41 bytes, plus one for each beat when the accents are custom.
+    /// Store `FORMAT_VERSION` ahead of them and pass it back to `readFrom()`, so later versions can add fields and
+    /// still read these.
+    void writeTo (juce::OutputStream& stream) const
+    {
+        const bool hasCustomAccents = rhythmPattern.useCustomAccents;
+        const int numCustomAccents = hasCustomAccents ? std::clamp (timeSignature.numerator, 1, RhythmPattern::MAX_BEATS_PER_MEASURE) : 0;
+
+        stream.writeDouble (bpm);
+        writeUint8 (stream, timeSignature.numerator);
+        writeUint8 (stream, timeSignature.denominator);
+        writeUint8 (stream, static_cast<int> (clickSound));
+        writeUint8 (stream, (syncToHost ? SYNC_TO_HOST : 0) | (hasCustomAccents ? CUSTOM_ACCENTS : 0)
+                                | (midiOutput.sendNotes ? SEND_MIDI_NOTES : 0) | (midiOutput.sendClock ? SEND_MIDI_CLOCK : 0));
+        writeUint8 (stream, rhythmPattern.pulsesPerBeat);
+
+        for (const auto group : rhythmPattern.groups)
+            writeUint8 (stream, group);
+
+        writeUint8 (stream, numCustomAccents);
+        for (int beat = 0; beat < numCustomAccents; ++beat)
+            writeUint8 (stream, static_cast<int> (rhythmPattern.beatAccents[static_cast<size_t> (beat)]));
+
+        writeUint8 (stream, midiOutput.channel);
+        writeUint8 (stream, midiOutput.downbeatNote);
+        writeUint8 (stream, midiOutput.beatNote);
+        stream.writeFloat (static_cast<float> (midiOutput.noteLengthSeconds));
+        stream.writeFloat (static_cast<float> (lookAheadSeconds));
+    }
+
+    /// Reads settings written by `writeTo()` in format `version`. Returns nothing if the data is cut short or isn't
+    /// valid settings, e.g. from a damaged session, and clamps numbers into their usual ranges.
+    [[nodiscard]] static std::optional<MetronomeSettings> readFrom (juce::InputStream& stream, const int version)
+    {
+        if (version < 1 || version > FORMAT_VERSION || stream.getNumBytesRemaining() < MIN_SIZE_IN_BYTES)
+            return std::nullopt;
+
+        MetronomeSettings settings;
+        const double bpm = stream.readDouble();
+        settings.bpm = std::isfinite (bpm) ? std::clamp (bpm, MIN_BPM, MAX_BPM) : 120.0;
+        settings.timeSignature.numerator = std::clamp (readUint8 (stream), 1, RhythmPattern::MAX_BEATS_PER_MEASURE);
+        settings.timeSignature.denominator = readUint8 (stream);
+
+        const int clickSound = readUint8 (stream);
+        const int flags = readUint8 (stream);
+        settings.clickSound = static_cast<ClickSound> (clickSound);
+        settings.syncToHost = (flags & SYNC_TO_HOST) != 0;
+        settings.rhythmPattern.useCustomAccents = (flags & CUSTOM_ACCENTS) != 0;
+        settings.midiOutput.sendNotes = (flags & SEND_MIDI_NOTES) != 0;
+        settings.midiOutput.sendClock = (flags & SEND_MIDI_CLOCK) != 0;
+        settings.rhythmPattern.pulsesPerBeat = std::clamp (readUint8 (stream), 1, AccentPattern::MAX_PULSES_PER_BEAT);
+
+        for (auto& group : settings.rhythmPattern.groups)
+            group = static_cast<uint8_t> (std::min (readUint8 (stream), RhythmPattern::MAX_BEATS_PER_MEASURE));
+
+        const int numCustomAccents = readUint8 (stream);
+        if (numCustomAccents > RhythmPattern::MAX_BEATS_PER_MEASURE || stream.getNumBytesRemaining() < numCustomAccents + TAIL_SIZE_IN_BYTES)
+            return std::nullopt;
+
+        for (int beat = 0; beat < numCustomAccents; ++beat)
+        {
+            const int accent = readUint8 (stream);
+            if (accent > static_cast<int> (Accent::silent))
+                return std::nullopt;
+
+            settings.rhythmPattern.beatAccents[static_cast<size_t> (beat)] = static_cast<Accent> (accent);
+        }
+
+        settings.midiOutput.channel = std::clamp (readUint8 (stream), 1, 16);
+        settings.midiOutput.downbeatNote = std::min (readUint8 (stream), 127);
+        settings.midiOutput.beatNote = std::min (readUint8 (stream), 127);
+        settings.midiOutput.noteLengthSeconds = juce::jlimit (0.001, 10.0, static_cast<double> (stream.readFloat()));
+        settings.lookAheadSeconds = juce::jlimit (0.0, MAX_LOOK_AHEAD_SECONDS, static_cast<double> (stream.readFloat()));
+
+        const int denominator = settings.timeSignature.denominator;
+        if (! juce::isPowerOfTwo (denominator) || denominator < 1 || denominator > 64 || clickSound > static_cast<int> (ClickSound::synth))
+            return std::nullopt;
+
+        return settings;
+    }
+
+private:
+    enum Flags
+    {
+        SYNC_TO_HOST = 1,
+        CUSTOM_ACCENTS = 2,
+        SEND_MIDI_NOTES = 4,
+        SEND_MIDI_CLOCK = 8
+    };
+
+    static constexpr int TAIL_SIZE_IN_BYTES = 3 + 4 + 4; // MIDI channel and notes, note length and look-ahead
+    static constexpr int MIN_SIZE_IN_BYTES = 8 + 5 + RhythmPattern::MAX_GROUPS + 1 + TAIL_SIZE_IN_BYTES;
+
+    static void writeUint8 (juce::OutputStream& stream, const int value) { stream.writeByte (static_cast<char> (static_cast<uint8_t> (value))); }
+    [[nodiscard]] static int readUint8 (juce::InputStream& stream) { return static_cast<uint8_t> (stream.readByte()); }
+};
+
+/// A `MetronomeSettings` ready for the audio thread to play, with its accent pattern compiled up front.
+///
+/// Snapshots are immutable and built off the audio thread, which switches to one with a single pointer exchange in a
+/// `SnapshotExchange`, so a whole preset lands at once at the start of a block and costs the audio thread a copy.
+struct MetronomeSnapshot
+{
+    explicit MetronomeSnapshot (const MetronomeSettings& settingsIn) : settings (settingsIn)
+    {
+        pattern.compile (settings.timeSignature, settings.rhythmPattern);
+    }
+
+    [[nodiscard]] static std::shared_ptr<const MetronomeSnapshot> make (const MetronomeSettings& settings)
+    {
+        return std::make_shared<const MetronomeSnapshot> (settings);
+    }
+
+    const MetronomeSettings settings;
+    AccentPattern pattern; // `settings`' time signature and rhythm pattern, compiled
+};
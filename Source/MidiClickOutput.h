@@ -0,0 +1,266 @@
+#pragma once
+
+#include "AccentPattern.h"
+#include "BeatClock.h"
+#include <array>
+#include <cmath>
+#include <juce_audio_basics/juce_audio_basics.h>
+
+/// Turns the metronome's clicks and pulses into MIDI: a note for every click, and 24 PPQN MIDI clock with start, continue
+/// and stop, so hardware and other plugins can follow the metronome without a clock generator of their own.
+///
+/// Every message goes on the sample the scheduler put its click or pulse on. Clock ticks are spread evenly through each
+/// pulse, from the pulse's own ideal position to the next one's, so they share the scheduler's drift-free positions,
+/// follow tempo maps and always land on the clicks. Nothing here allocates: every message fits in `juce::MidiMessage`'s
+/// inline storage, and goes straight into the block's `juce::MidiBuffer`, which the caller must give room for a block's
+/// messages, as `AudioPluginAudioProcessor` does.
+///
+/// With a delay set, messages are held in a small preallocated list of future events instead, and added to the block
+/// they fall in. The metronome uses that to play its clicks ahead of the MIDI, see `Metronome::setLookAhead()`.
+class MidiClickOutput
+{
+public:
+    static constexpr int CLOCK_TICKS_PER_QUARTER_NOTE = 24;
+
+    /// Trivially copyable, so it can be sent to the audio thread in a `MetronomeSnapshot`.
+    struct Settings
+    {
+        bool sendNotes = false;
+        bool sendClock = false; // with start, continue and stop messages
+        int channel = 10; // 1-16, where 10 is the General MIDI drum channel
+        int downbeatNote = 76; // General MIDI high wood block, for downbeats and group accents
+        int beatNote = 77; // General MIDI low wood block, for beats and subdivisions
+        double noteLengthSeconds = 0.05;
+
+        bool operator== (const Settings& other) const = default;
+    };
+
+    void prepare (const double sampleRateIn) noexcept { sampleRate = sampleRateIn; }
+
+    void setSettings (const Settings& newSettings) noexcept { settings = newSettings; }
+    [[nodiscard]] const Settings& getSettings() const noexcept { return settings; }
+
+    /// Sends every message `numSamples` after the position it's given for. Messages already waiting keep their time.
+    void setDelay (const int numSamples) noexcept { delay = std::max (numSamples, 0); }
+
+    /// Whether MIDI clock is running, i.e. a start or continue has been sent but no stop since.
+    [[nodiscard]] bool isClockRunning() const noexcept { return clockIsRunning; }
+
+    /// Forgets the pulse in progress, e.g. when the timeline restarts or jumps. Notes still on stay on, and the clock
+    /// keeps running.
+    void resetClock() noexcept { pulse = {}; }
+
+    /// Moves on to a pulse that starts at `position` samples from the start of the block, and lasts `lengthInSamples`
+    /// samples and `lengthInTicks` clock ticks. The ticks left in the previous pulse before this one are sent first, and
+    /// this pulse carries on from where the previous one left the tick grid.
+    ///
+    /// If clock is enabled but not running yet, it starts on the next downbeat, which is where a MIDI start says the
+    /// song begins.
+    void startPulse (juce::MidiBuffer& midi, const double position, const double lengthInSamples, const double lengthInTicks, const bool isDownbeat) noexcept
+    {
+        addClockTicksBefore (midi, position);
+
+        const double tickPhase = pulse.lengthInSamples > 0.0 ? pulse.tickPhase + pulse.lengthInTicks : 0.0;
+        setPulse (position, lengthInSamples, lengthInTicks, tickPhase - std::floor (tickPhase));
+
+        if (settings.sendClock && ! clockIsRunning && isDownbeat)
+        {
+            addEvent (midi, juce::MidiMessage::midiStart(), BeatClock::toSampleIndex (position));
+            clockIsRunning = true;
+            setPulse (position, lengthInSamples, lengthInTicks, 0.0);
+        }
+    }
+
+    /// Sets the pulse in progress after the timeline jumps, e.g. at a host locate or loop. It starts `tickPhase` ticks
+    /// past a clock tick. Its ticks before `fromPosition` are taken as sent already, so none are sent twice.
+    void locatePulse (const double position, const double lengthInSamples, const double lengthInTicks, const double tickPhase, const double fromPosition) noexcept
+    {
+        setPulse (position, lengthInSamples, lengthInTicks, tickPhase);
+        while (pulse.nextTick < pulse.lengthInTicks && getTickPosition() < fromPosition)
+            pulse.nextTick += 1.0;
+    }
+
+    /// Sends the ticks of the pulse in progress that round to a sample before `endSample`.
+    void addClockTicksUpTo (juce::MidiBuffer& midi, const int endSample) noexcept
+    {
+        addClockTicksBefore (midi, endSample - 0.5);
+    }
+
+    /// Starts the clock from `quarterNotePosition` on the song's timeline, e.g. when the host starts playing. It sends
+    /// a song position and continue, or just a start at the very beginning of the song.
+    void startClockAt (juce::MidiBuffer& midi, const int samplePosition, const double quarterNotePosition) noexcept
+    {
+        if (! settings.sendClock || clockIsRunning)
+            return;
+
+        // Song position counts 16th notes
+        const int sixteenths = std::max (static_cast<int> (std::lround (quarterNotePosition * 4.0)), 0);
+        if (sixteenths == 0)
+        {
+            addEvent (midi, juce::MidiMessage::midiStart(), samplePosition);
+        }
+        else
+        {
+            addEvent (midi, juce::MidiMessage::songPositionPointer (sixteenths), samplePosition);
+            addEvent (midi, juce::MidiMessage::midiContinue(), samplePosition);
+        }
+        clockIsRunning = true;
+    }
+
+    /// Ends every note still on and stops the clock, at `samplePosition`.
+    void stop (juce::MidiBuffer& midi, const int samplePosition) noexcept
+    {
+        for (size_t slot = 0; slot < noteOffPositions.size(); ++slot)
+            if (noteOffPositions[slot] >= 0)
+                addNoteOff (midi, slot, samplePosition);
+
+        if (clockIsRunning)
+            addEvent (midi, juce::MidiMessage::midiStop(), samplePosition);
+
+        clockIsRunning = false;
+        resetClock();
+    }
+
+    /// Sends a note for a click of `accent` at `samplePosition`. The previous note of the same pitch is ended first if
+    /// it's still on.
+    void addClick (juce::MidiBuffer& midi, const int samplePosition, const Accent accent) noexcept
+    {
+        if (! settings.sendNotes || accent == Accent::silent)
+            return;
+
+        // The same sounds and levels as the audio clicks
+        const bool isDownbeat = accent == Accent::downbeat || accent == Accent::strong;
+        const float gain = getAccentGain (accent);
+        const size_t slot = isDownbeat ? 0 : 1;
+
+        if (noteOffPositions[slot] >= 0)
+            addNoteOff (midi, slot, std::min (noteOffPositions[slot], samplePosition));
+
+        addEvent (midi, juce::MidiMessage::noteOn (settings.channel, getNote (slot), static_cast<juce::uint8> (std::lround (gain * 127.0f))), samplePosition);
+        noteOffPositions[slot] = samplePosition + std::max (static_cast<int> (std::lround (settings.noteLengthSeconds * sampleRate)), 1);
+    }
+
+    /// Sends the rest of the block's clock ticks, note offs and delayed messages, then moves on to the next block.
+    void finishBlock (juce::MidiBuffer& midi, const int numSamples) noexcept
+    {
+        if (clockIsRunning && ! settings.sendClock) // clock turned off while running
+        {
+            addEvent (midi, juce::MidiMessage::midiStop(), 0);
+            clockIsRunning = false;
+        }
+
+        addClockTicksUpTo (midi, numSamples);
+        pulse.position -= numSamples;
+
+        for (size_t slot = 0; slot < noteOffPositions.size(); ++slot)
+        {
+            if (noteOffPositions[slot] < 0)
+                continue;
+
+            if (noteOffPositions[slot] < numSamples)
+                addNoteOff (midi, slot, noteOffPositions[slot]);
+            else
+                noteOffPositions[slot] -= numSamples;
+        }
+
+        // Send the delayed messages that fall in this block, keeping the rest in order at the front of the list
+        int numKept = 0;
+        for (int index = 0; index < numDelayedEvents; ++index)
+        {
+            auto& event = delayedEvents[static_cast<size_t> (index)];
+            if (event.samplePosition < numSamples)
+            {
+                midi.addEvent (event.message, event.samplePosition);
+                continue;
+            }
+
+            event.samplePosition -= numSamples;
+            delayedEvents[static_cast<size_t> (numKept++)] = event;
+        }
+        numDelayedEvents = numKept;
+    }
+
+private:
+    /// The pulse clock ticks are being sent for. Tick `n` of the tick grid within it ideally falls at
+    /// `position + (n - tickPhase) * lengthInSamples / lengthInTicks`.
+    struct Pulse
+    {
+        double position = 0.0; // samples from the start of the current block
+        double lengthInSamples = 0.0; // 0 when there's no pulse in progress
+        double lengthInTicks = 0.0;
+        double tickPhase = 0.0; // how far past a tick the pulse starts, from 0 up to 1 tick
+        double nextTick = 0.0; // ticks from the start of the pulse to the next tick to send
+    };
+
+    void setPulse (const double position, const double lengthInSamples, const double lengthInTicks, const double tickPhase) noexcept
+    {
+        // A pulse starting a hair past a tick (from rounding in the host's position) counts as starting on it
+        static constexpr double TICK_TOLERANCE = 1.0e-6;
+
+        pulse.position = position;
+        pulse.lengthInSamples = lengthInSamples;
+        pulse.lengthInTicks = lengthInTicks;
+        pulse.tickPhase = tickPhase;
+        pulse.nextTick = std::max (std::ceil (tickPhase - TICK_TOLERANCE) - tickPhase, 0.0);
+    }
+
+    [[nodiscard]] double getTickPosition() const noexcept
+    {
+        return pulse.position + pulse.nextTick * pulse.lengthInSamples / pulse.lengthInTicks;
+    }
+
+    void addClockTicksBefore (juce::MidiBuffer& midi, const double endPosition) noexcept
+    {
+        if (pulse.lengthInSamples <= 0.0)
+            return;
+
+        for (; pulse.nextTick < pulse.lengthInTicks; pulse.nextTick += 1.0)
+        {
+            const double position = getTickPosition();
+            if (position >= endPosition)
+                break;
+
+            if (clockIsRunning)
+                addEvent (midi, juce::MidiMessage::midiClock(), BeatClock::toSampleIndex (position));
+        }
+    }
+
+    /// Adds `message` to the block at `samplePosition`, or to the delayed events for a later block.
+    void addEvent (juce::MidiBuffer& midi, const juce::MidiMessage& message, const int samplePosition) noexcept
+    {
+        if (delay == 0)
+        {
+            midi.addEvent (message, samplePosition);
+            return;
+        }
+
+        // Far more than the events in any sensible delay. If it fills up, e.g. at absurd tempos, later events are dropped.
+        if (numDelayedEvents < MAX_DELAYED_EVENTS)
+            delayedEvents[static_cast<size_t> (numDelayedEvents++)] = { message, samplePosition + delay };
+    }
+
+    [[nodiscard]] int getNote (const size_t slot) const noexcept { return slot == 0 ? settings.downbeatNote : settings.beatNote; }
+
+    void addNoteOff (juce::MidiBuffer& midi, const size_t slot, const int samplePosition) noexcept
+    {
+        addEvent (midi, juce::MidiMessage::noteOff (settings.channel, getNote (slot)), samplePosition);
+        noteOffPositions[slot] = -1;
+    }
+
+    static constexpr int MAX_DELAYED_EVENTS = 1024;
+
+    struct DelayedEvent
+    {
+        juce::MidiMessage message; // every message we send fits in its inline storage, so copying never allocates
+        int samplePosition = 0; // from the start of the current block
+    };
+
+    Settings settings;
+    double sampleRate = 44100.0;
+    int delay = 0;
+    std::array<DelayedEvent, MAX_DELAYED_EVENTS> delayedEvents {};
+    int numDelayedEvents = 0;
+    Pulse pulse;
+    bool clockIsRunning = false;
+    std::array<int, 2> noteOffPositions { -1, -1 }; // samples from the start of the current block, or -1 if the note is off
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Metronome.h"
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_core/juce_core.h>
+
+/// Renders click tracks faster than real time, e.g. to print long rehearsal stems straight to a WAV or FLAC file.
+///
+/// The track is split into segments that render independently on a thread pool. Each segment seeks its own
+/// `Metronome` to the segment start and renders one click length of pre-roll first, so clicks ringing across a
+/// segment boundary are restored and the segments stitch together sample-exactly. While one batch of segments is
+/// being written, the next batch renders, so only two batches are ever held in memory however long the track is.
+class OfflineRenderer
+{
+public:
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        double bpm = 120.0;
+        TimeSignature timeSignature = { { 4 }, { 4 } };
+        TempoMap tempoMap; // if not empty, overrides `bpm` and `timeSignature`
+        double durationSeconds = 60.0;
+        int numChannels = 2;
+        int blockSize = 512; // the metronome processes in blocks of this size, like it would in a host
+        double segmentSeconds = 10.0;
+        int numThreads = juce::SystemStats::getNumCpus();
+    };
+
+    /// Renders the whole click track into `writer`.
+    static juce::Result render (const Settings& settings, juce::AudioFormatWriter& writer)
+    {
+        // Keeps the click samples alive for the whole render. Otherwise every segment's `Metronome` would load and
+        // resample them again whenever the last one before it had gone. Declared first, so it outlives the pool.
+        const auto clickSampleLibrary = ClickSampleLibrary::getInstance();
+
+        const auto totalSamples = static_cast<juce::int64> (std::llround (settings.durationSeconds * settings.sampleRate));
+        const auto segmentLength = std::max (static_cast<juce::int64> (settings.segmentSeconds * settings.sampleRate), static_cast<juce::int64> (settings.blockSize));
+        const auto numSegments = (totalSamples + segmentLength - 1) / segmentLength;
+        const int segmentsPerBatch = std::max (settings.numThreads, 1);
+        const auto numBatches = (numSegments + segmentsPerBatch - 1) / segmentsPerBatch;
+
+        // Two batches' worth of segments: one batch renders while the other is written.
+        // Declared before the pool, so the pool finishes any running jobs before the segments are destroyed.
+        std::vector<std::unique_ptr<SegmentJob>> segments;
+        for (int i = 0; i < 2 * segmentsPerBatch; ++i)
+            segments.push_back (std::make_unique<SegmentJob> (settings, static_cast<int> (segmentLength)));
+
+        juce::ThreadPool pool (segmentsPerBatch);
+
+        auto forEachSegmentInBatch = [&] (const juce::int64 batch, auto&& function)
+        {
+            for (int i = 0; i < segmentsPerBatch; ++i)
+            {
+                const auto segmentIndex = batch * segmentsPerBatch + i;
+                if (segmentIndex >= numSegments)
+                    return true;
+
+                auto& segment = *segments[static_cast<size_t> ((batch % 2) * segmentsPerBatch + i)];
+                if (! function (segment, segmentIndex * segmentLength))
+                    return false;
+            }
+            return true;
+        };
+
+        auto startBatch = [&] (const juce::int64 batch)
+        {
+            forEachSegmentInBatch (batch, [&] (SegmentJob& segment, const juce::int64 startSample)
+                                   {
+                                       segment.startSample = startSample;
+                                       segment.numSamples = static_cast<int> (std::min (segmentLength, totalSamples - startSample));
+                                       pool.addJob (&segment, false);
+                                       return true;
+                                   });
+        };
+
+        if (numBatches > 0)
+            startBatch (0);
+
+        for (juce::int64 batch = 0; batch < numBatches; ++batch)
+        {
+            if (batch + 1 < numBatches)
+                startBatch (batch + 1);
+
+            const bool wroteBatch = forEachSegmentInBatch (batch, [&] (SegmentJob& segment, juce::int64)
+                                                           {
+                                                               pool.waitForJobToFinish (&segment, -1);
+                                                               return writer.writeFromAudioSampleBuffer (segment.buffer, 0, segment.numSamples);
+                                                           });
+            if (! wroteBatch)
+                return juce::Result::fail ("Failed writing the click track");
+        }
+
+        return juce::Result::ok();
+    }
+
+    /// Renders the whole click track to `file`, choosing the format (e.g. WAV or FLAC) from the file extension.
+    static juce::Result renderToFile (const Settings& settings, const juce::File& file, const int bitsPerSample = 24)
+    {
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        auto* format = formatManager.findFormatForFileExtension (file.getFileExtension());
+        if (format == nullptr)
+            return juce::Result::fail ("Unsupported audio file type: " + file.getFileExtension());
+
+        file.deleteFile(); // FileOutputStream appends to existing files
+        std::unique_ptr<juce::OutputStream> stream (file.createOutputStream());
+        if (stream == nullptr)
+            return juce::Result::fail ("Couldn't open " + file.getFullPathName() + " for writing");
+
+        const std::unique_ptr<juce::AudioFormatWriter> writer (format->createWriterFor (stream.get(), settings.sampleRate, static_cast<unsigned int> (settings.numChannels), bitsPerSample, {}, 0));
+        if (writer == nullptr)
+            return juce::Result::fail ("The file format doesn't support this sample rate, channel count or bit depth");
+
+        stream.release(); // the writer owns the stream now
+        return render (settings, *writer);
+    }
+
+    /// Renders the part of the click track starting at `startSample` into the whole of `output`.
+    static void renderSegment (const Settings& settings, const juce::int64 startSample, juce::AudioBuffer<float>& output)
+    {
+        Metronome metronome;
+        metronome.setBPM (settings.bpm);
+        metronome.setTimeSignature (settings.timeSignature);
+        metronome.setTempoMap (settings.tempoMap);
+        metronome.prepareToPlay (settings.sampleRate, settings.blockSize);
+
+        // Restore any clicks still ringing from before the segment by rendering up to one click length of pre-roll
+        const auto preRollStart = std::max (startSample - metronome.getLongestClickLength(), juce::int64 { 0 });
+        metronome.seek (preRollStart);
+
+        juce::AudioBuffer<float> preRoll (output.getNumChannels(), settings.blockSize);
+        for (auto position = preRollStart; position < startSample; position += settings.blockSize)
+        {
+            const auto numSamples = static_cast<int> (std::min (static_cast<juce::int64> (settings.blockSize), startSample - position));
+            juce::AudioBuffer<float> block (preRoll.getArrayOfWritePointers(), preRoll.getNumChannels(), 0, numSamples);
+            metronome.process (block);
+        }
+
+        for (int position = 0; position < output.getNumSamples(); position += settings.blockSize)
+        {
+            const int numSamples = std::min (settings.blockSize, output.getNumSamples() - position);
+            juce::AudioBuffer<float> block (output.getArrayOfWritePointers(), output.getNumChannels(), position, numSamples);
+            metronome.process (block);
+        }
+    }
+
+private:
+    struct SegmentJob final : public juce::ThreadPoolJob
+    {
+        SegmentJob (const Settings& settingsIn, const int maxSegmentLength)
+            : juce::ThreadPoolJob ("Click track segment"), settings (settingsIn), buffer (settingsIn.numChannels, maxSegmentLength)
+        {
+        }
+
+        JobStatus runJob() override
+        {
+            juce::AudioBuffer<float> segment (buffer.getArrayOfWritePointers(), buffer.getNumChannels(), 0, numSamples);
+            renderSegment (settings, startSample, segment);
+            return jobHasFinished;
+        }
+
+        const Settings& settings;
+        juce::AudioBuffer<float> buffer;
+        juce::int64 startSample = 0;
+        int numSamples = 0;
+    };
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <limits>
+
+/// Finds where hits start in an input signal, e.g. a drummer practising along with the clicks.
+///
+/// The input is cut into hops of about 1.5 ms and each hop's energy is measured. A hit is a rise of at least `RISE_DB`
+/// over the quieter of the two hops before, above a noise floor, and far enough after the last hit not to be its
+/// ringing. That's one logarithm per hop and a handful of numbers of state, so the cost per sample never changes
+/// however long it runs.
+class OnsetDetector
+{
+public:
+    static constexpr double HOP_SECONDS = 0.0015;
+    static constexpr float RISE_DB = 9.0f;
+    static constexpr float NOISE_FLOOR_DB = -50.0f;
+    static constexpr double MIN_ONSET_INTERVAL_SECONDS = 0.05;
+
+    void prepare (const double sampleRate)
+    {
+        hopSize = std::max (16, juce::roundToInt (sampleRate * HOP_SECONDS));
+        minOnsetInterval = static_cast<juce::int64> (sampleRate * MIN_ONSET_INTERVAL_SECONDS);
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        hopEnergy = 0.0;
+        hopFill = 0;
+        previousLevels.fill (NOISE_FLOOR_DB);
+        lastOnsetTime = std::numeric_limits<juce::int64>::min() / 2;
+    }
+
+    /// Looks for hits in the first `numChannels` of `input`, whose first sample is at `blockStartTime`, and calls
+    /// `onOnset (sampleTime)` with the start of the hop each one begins in. Hops carry on across blocks of any size.
+    template <typename SampleType, typename Callback>
+    void process (const juce::AudioBuffer<SampleType>& input, int numChannels, const juce::int64 blockStartTime, Callback&& onOnset) noexcept
+    {
+        numChannels = std::min (numChannels, input.getNumChannels());
+        if (numChannels <= 0)
+            return;
+
+        const int numSamples = input.getNumSamples();
+        for (int start = 0; start < numSamples;)
+        {
+            const int count = std::min (hopSize - hopFill, numSamples - start);
+            for (int channel = 0; channel < numChannels; ++channel)
+                hopEnergy += static_cast<double> (sumOfSquares (input.getReadPointer (channel, start), count));
+
+            start += count;
+            hopFill += count;
+            if (hopFill < hopSize)
+                break;
+
+            const auto hopStartTime = blockStartTime + start - hopSize;
+            if (endHop (hopEnergy / (hopSize * numChannels), hopStartTime))
+                onOnset (hopStartTime);
+
+            hopEnergy = 0.0;
+            hopFill = 0;
+        }
+    }
+
+private:
+    /// Four independent sums rather than one, so the compiler can keep them in a single SIMD register instead of
+    /// waiting on each add in turn.
+    template <typename SampleType>
+    [[nodiscard]] static SampleType sumOfSquares (const SampleType* samples, const int numSamples) noexcept
+    {
+        std::array<SampleType, 4> sums {};
+        int index = 0;
+        for (; index + 4 <= numSamples; index += 4)
+            for (size_t lane = 0; lane < sums.size(); ++lane)
+                sums[lane] += samples[index + static_cast<int> (lane)] * samples[index + static_cast<int> (lane)];
+
+        auto total = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+        for (; index < numSamples; ++index)
+            total += samples[index] * samples[index];
+
+        return total;
+    }
+
+    /// Returns true if a hit starts in the hop just measured.
+    bool endHop (const double meanSquare, const juce::int64 hopStartTime) noexcept
+    {
+        const auto level = static_cast<float> (10.0 * std::log10 (meanSquare + 1.0e-12));
+        const auto rise = level - std::min (previousLevels[0], previousLevels[1]);
+        previousLevels = { level, previousLevels[0] };
+
+        if (level < NOISE_FLOOR_DB || rise < RISE_DB || hopStartTime - lastOnsetTime < minOnsetInterval)
+            return false;
+
+        lastOnsetTime = hopStartTime;
+        return true;
+    }
+
+    int hopSize = 64;
+    juce::int64 minOnsetInterval = 2400;
+
+    double hopEnergy = 0.0; // summed over the channels so far in this hop
+    int hopFill = 0;
+    std::array<float, 2> previousLevels {}; // dB of the last two hops, newest first
+    juce::int64 lastOnsetTime = 0;
+};
@@ -1,6 +1,30 @@
 #include "PluginEditor.h"
 #include "PluginProcessor.h"
 
+static juce::String getGroupingText (const RhythmPattern& pattern)
+{
+    juce::String text;
+    for (const auto groupSize : pattern.groups)
+    {
+        if (groupSize == 0)
+            break;
+
+        text << (text.isEmpty() ? "" : "+") << juce::String (static_cast<int> (groupSize));
+    }
+
+    return text.isEmpty() ? juce::String ("No grouping") : text;
+}
+
+static juce::String getLookAheadText (const double seconds)
+{
+    return juce::String (juce::roundToInt (seconds * 1000.0)) + " ms ahead";
+}
+
+static juce::String getLatencyText (const double seconds)
+{
+    return juce::String (juce::roundToInt (seconds * 1000.0)) + " ms latency";
+}
+
 //==============================================================================
 AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor& p)
     : AudioProcessorEditor (&p), processorRef (p)
@@ -8,7 +32,9 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     juce::ignoreUnused (processorRef);
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (400, 300);
+    setSize (400, AudioThreadStats::IS_ENABLED ? 404 : 384);
+
+    addAndMakeVisible (beatIndicator);
 
     playStopButton.setToggleState (processorRef.isPlaying, juce::NotificationType::dontSendNotification);
     playStopButton.setClickingTogglesState (true);
@@ -19,11 +45,10 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     };
     addAndMakeVisible (playStopButton);
 
-    bpm.setRange (20.0, 1000.0);
-    bpm.setValue (processorRef.bpm);
+    bpm.setRange (MetronomeSettings::MIN_BPM, MetronomeSettings::MAX_BPM);
     bpm.onValueChange = [this]()
     {
-        processorRef.bpm = bpm.getValue();
+        processorRef.setBPM (bpm.getValue());
     };
     addAndMakeVisible (bpm);
 
@@ -40,7 +65,7 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
                 value = std::clamp (value, 1, 99);
 
                 label.setText (juce::String (value), juce::dontSendNotification);
-                processorRef.timeSigNumerator = value;
+                processorRef.setTimeSignature ({ { value }, { processorRef.getSettings().timeSignature.denominator } });
             };
         }
         else
@@ -62,7 +87,7 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
                 }
 
                 label.setText (juce::String (closestValidValue), juce::dontSendNotification);
-                processorRef.timeSigDenominator = closestValidValue;
+                processorRef.setTimeSignature ({ { processorRef.getSettings().timeSignature.numerator }, { closestValidValue } });
             };
         }
 
@@ -71,6 +96,135 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
 
     setupLabel (timeSignatureNumerator, true);
     setupLabel (timeSignatureDenominator, false);
+
+    hostSyncButton.onClick = [this]()
+    {
+        processorRef.setSyncToHost (hostSyncButton.getToggleState());
+    };
+    addAndMakeVisible (hostSyncButton);
+
+    synthClickButton.onClick = [this]()
+    {
+        processorRef.setClickSound (synthClickButton.getToggleState() ? ClickSound::synth : ClickSound::samples);
+    };
+    addAndMakeVisible (synthClickButton);
+
+    // Sends a drum note for every click and MIDI clock, e.g. to drive hardware from the metronome
+    midiOutputButton.onClick = [this]()
+    {
+        auto settings = processorRef.getSettings().midiOutput;
+        settings.sendNotes = settings.sendClock = midiOutputButton.getToggleState();
+        processorRef.setMidiOutput (settings);
+    };
+    addAndMakeVisible (midiOutputButton);
+
+    // A folder of the user's own click samples, loaded in the background
+    updateClickKitButton();
+    clickKitButton.onClick = [this]()
+    {
+        showClickKitMenu();
+    };
+    addAndMakeVisible (clickKitButton);
+
+    // Item IDs are the number of pulses per beat
+    subdivision.addItem ("No subdivision", 1);
+    subdivision.addItem ("8ths", 2);
+    subdivision.addItem ("Triplets", 3);
+    subdivision.addItem ("16ths", 4);
+    subdivision.onChange = [this]()
+    {
+        auto pattern = processorRef.getSettings().rhythmPattern;
+        pattern.pulsesPerBeat = subdivision.getSelectedId();
+        processorRef.setRhythmPattern (pattern);
+    };
+    addAndMakeVisible (subdivision);
+
+    // Beat grouping for accents, typed like "2+2+3". Without a grouping only the downbeat is accented.
+    beatGrouping.setEditable (true);
+    beatGrouping.onTextChange = [this]()
+    {
+        auto pattern = processorRef.getSettings().rhythmPattern;
+        pattern.groups.fill (0);
+
+        juce::StringArray groupSizes;
+        groupSizes.addTokens (beatGrouping.getText(), "+", "");
+
+        size_t numGroups = 0;
+        for (const auto& groupSize : groupSizes)
+        {
+            const int value = groupSize.getIntValue();
+            if (value <= 0 || numGroups == pattern.groups.size())
+                continue;
+
+            pattern.groups[numGroups++] = static_cast<uint8_t> (std::min (value, RhythmPattern::MAX_BEATS_PER_MEASURE));
+        }
+
+        beatGrouping.setText (getGroupingText (pattern), juce::dontSendNotification);
+        processorRef.setRhythmPattern (pattern);
+    };
+    addAndMakeVisible (beatGrouping);
+
+    // Output latency to make up for, typed in milliseconds
+    lookAhead.setEditable (true);
+    lookAhead.onTextChange = [this]()
+    {
+        const double seconds = juce::jlimit (0.0, MetronomeSettings::MAX_LOOK_AHEAD_SECONDS, lookAhead.getText().getDoubleValue() / 1000.0);
+        lookAhead.setText (getLookAheadText (seconds), juce::dontSendNotification);
+        processorRef.setLookAhead (seconds);
+    };
+    addAndMakeVisible (lookAhead);
+
+    // Setlist presets: click an empty one to store the current settings, click a stored one to switch to it, and
+    // shift-click to store over it
+    for (int index = 0; index < PresetBank::NUM_PRESETS; ++index)
+    {
+        auto& button = presetButtons[static_cast<size_t> (index)];
+        button.setButtonText (juce::String (index + 1));
+        button.onClick = [this, index]()
+        {
+            if (juce::ModifierKeys::getCurrentModifiers().isShiftDown() || ! processorRef.hasPreset (index))
+                processorRef.storePreset (index);
+            else
+                processorRef.recallPreset (index);
+
+            updateControls();
+        };
+        addAndMakeVisible (button);
+    }
+
+    updateControls();
+
+    // Measures the player's hits on the input against the clicks, e.g. a drum pad or a mic with headphones on
+    analyseInputButton.setToggleState (processorRef.timingAnalyzer.isEnabled(), juce::NotificationType::dontSendNotification);
+    analyseInputButton.onClick = [this]()
+    {
+        processorRef.timingAnalyzer.setEnabled (analyseInputButton.getToggleState());
+    };
+    addAndMakeVisible (analyseInputButton);
+
+    // Round-trip latency to take off each hit, typed in milliseconds
+    timingLatency.setEditable (true);
+    timingLatency.setFont (juce::FontOptions (12.0f));
+    timingLatency.setText (getLatencyText (processorRef.timingAnalyzer.getLatency()), juce::dontSendNotification);
+    timingLatency.onTextChange = [this]()
+    {
+        const double seconds = juce::jlimit (0.0, 1.0, timingLatency.getText().getDoubleValue() / 1000.0);
+        timingLatency.setText (getLatencyText (seconds), juce::dontSendNotification);
+        processorRef.timingAnalyzer.setLatency (seconds);
+    };
+    addAndMakeVisible (timingLatency);
+
+    timingStats.setFont (juce::FontOptions (12.0f));
+    addAndMakeVisible (timingStats);
+
+    if (AudioThreadStats::IS_ENABLED)
+    {
+        audioThreadStats.setFont (juce::FontOptions (12.0f));
+        audioThreadStats.setJustificationType (juce::Justification::centred);
+        addAndMakeVisible (audioThreadStats);
+    }
+
+    startTimerHz (4);
 }
 
 AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor()
@@ -82,10 +236,80 @@ void AudioPluginAudioProcessorEditor::paint (juce::Graphics& g)
 {
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
+}
+
+void AudioPluginAudioProcessorEditor::timerCallback()
+{
+    if (processorRef.timingAnalyzer.isEnabled())
+    {
+        const auto timing = processorRef.timingAnalyzer.getStats().all;
+        timingStats.setText (timing.numHits == 0 ? juce::String ("Play along to measure your timing")
+                                                 : juce::String (timing.numHits) + " hits, " + juce::String (std::abs (timing.meanMs), 1)
+                                                       + (timing.meanMs < 0.0 ? " ms early" : " ms late") + ", jitter "
+                                                       + juce::String (timing.jitterMs, 1) + " ms",
+                             juce::dontSendNotification);
+    }
+    else
+    {
+        timingStats.setText ({}, juce::dontSendNotification);
+    }
+
+    if (AudioThreadStats::IS_ENABLED)
+    {
+        const auto stats = processorRef.audioThreadStats.getSnapshot();
+        audioThreadStats.setText ("Worst load " + juce::String (stats.worstLoad * 100.0, 1) + "%, overruns " + juce::String (stats.numOverruns)
+                                      + ", voices " + juce::String (stats.numActiveVoices) + " (peak " + juce::String (stats.peakActiveVoices) + ")",
+                                  juce::dontSendNotification);
+    }
+}
 
-    g.setColour (juce::Colours::white);
-    g.setFont (15.0f);
-    g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
+void AudioPluginAudioProcessorEditor::updateControls()
+{
+    const auto settings = processorRef.getSettings();
+    bpm.setValue (settings.bpm, juce::dontSendNotification);
+    timeSignatureNumerator.setText (juce::String (settings.timeSignature.numerator), juce::dontSendNotification);
+    timeSignatureDenominator.setText (juce::String (settings.timeSignature.denominator), juce::dontSendNotification);
+    hostSyncButton.setToggleState (settings.syncToHost, juce::NotificationType::dontSendNotification);
+    synthClickButton.setToggleState (settings.clickSound == ClickSound::synth, juce::NotificationType::dontSendNotification);
+    midiOutputButton.setToggleState (settings.midiOutput.sendNotes, juce::NotificationType::dontSendNotification);
+    subdivision.setSelectedId (settings.rhythmPattern.pulsesPerBeat, juce::dontSendNotification);
+    beatGrouping.setText (getGroupingText (settings.rhythmPattern), juce::dontSendNotification);
+    lookAhead.setText (getLookAheadText (settings.lookAheadSeconds), juce::dontSendNotification);
+
+    // Stored presets are lit
+    for (int index = 0; index < PresetBank::NUM_PRESETS; ++index)
+        presetButtons[static_cast<size_t> (index)].setToggleState (processorRef.hasPreset (index), juce::NotificationType::dontSendNotification);
+}
+
+void AudioPluginAudioProcessorEditor::showClickKitMenu()
+{
+    juce::PopupMenu menu;
+    menu.addItem ("Load kit folder...", [this]()
+                  {
+                      clickKitChooser = std::make_unique<juce::FileChooser> ("Choose a folder of downbeat, strong, beat and subdivision WAV or AIFF files",
+                                                                             processorRef.getClickKitFolder());
+                      clickKitChooser->launchAsync (juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectDirectories,
+                                                    [this] (const juce::FileChooser& chooser)
+                                                    {
+                                                        if (chooser.getResult() == juce::File())
+                                                            return;
+
+                                                        processorRef.loadClickKit (chooser.getResult());
+                                                        updateClickKitButton();
+                                                    });
+                  });
+    menu.addItem ("Built-in clicks", [this]()
+                  {
+                      processorRef.loadClickKit ({});
+                      updateClickKitButton();
+                  });
+    menu.showMenuAsync (juce::PopupMenu::Options().withTargetComponent (clickKitButton));
+}
+
+void AudioPluginAudioProcessorEditor::updateClickKitButton()
+{
+    const auto folder = processorRef.getClickKitFolder();
+    clickKitButton.setButtonText (folder == juce::File() ? "Built-in clicks" : folder.getFileName());
 }
 
 void AudioPluginAudioProcessorEditor::resized()
@@ -93,10 +317,36 @@ void AudioPluginAudioProcessorEditor::resized()
     constexpr int padding = 8;
 
     auto bounds = getLocalBounds();
-    playStopButton.setBounds (bounds.removeFromTop (bounds.getHeight() * 2 / 3).reduced (padding));
+    if (AudioThreadStats::IS_ENABLED)
+        audioThreadStats.setBounds (bounds.removeFromBottom (20));
+
+    auto presetRow = bounds.removeFromBottom (30).reduced (padding - 2, 2);
+    const int presetWidth = presetRow.getWidth() / PresetBank::NUM_PRESETS;
+    for (auto& button : presetButtons)
+        button.setBounds (presetRow.removeFromLeft (presetWidth).reduced (2, 0));
+
+    auto timingRow = bounds.removeFromBottom (24);
+    analyseInputButton.setBounds (timingRow.removeFromLeft (110).reduced (padding, 0));
+    timingLatency.setBounds (timingRow.removeFromRight (90).reduced (padding, 0));
+    timingStats.setBounds (timingRow.reduced (padding, 0));
+
+    beatIndicator.setBounds (bounds.removeFromTop (30).reduced (padding, 4));
+    playStopButton.setBounds (bounds.removeFromTop (bounds.getHeight() / 2).reduced (padding));
+
+    constexpr int hostSyncButtonWidth = 110;
+    const auto rowHeight = bounds.getHeight() / 3;
+    auto bpmRow = bounds.removeFromTop (rowHeight);
+    midiOutputButton.setBounds (bpmRow.removeFromRight (hostSyncButtonWidth).reduced (padding));
+    clickKitButton.setBounds (bpmRow.removeFromLeft (hostSyncButtonWidth).reduced (padding));
+    bpm.setBounds (bpmRow.reduced (padding));
+
+    auto patternRow = bounds.removeFromBottom (rowHeight);
+    subdivision.setBounds (patternRow.removeFromLeft (patternRow.getWidth() / 2).reduced (padding));
+    lookAhead.setBounds (patternRow.removeFromRight (hostSyncButtonWidth).reduced (padding));
+    beatGrouping.setBounds (patternRow.reduced (padding));
 
-    const auto bottomHeight = bounds.getHeight();
-    bpm.setBounds (bounds.removeFromTop (bottomHeight / 2).reduced (padding));
+    hostSyncButton.setBounds (bounds.removeFromRight (hostSyncButtonWidth).reduced (padding));
+    synthClickButton.setBounds (bounds.removeFromLeft (hostSyncButtonWidth).reduced (padding));
 
     auto left = bounds.removeFromLeft (bounds.getWidth() / 2);
     auto right = bounds;
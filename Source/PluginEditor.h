@@ -1,9 +1,10 @@
 #pragma once
 
+#include "BeatIndicator.h"
 #include "PluginProcessor.h"
 
 //==============================================================================
-class AudioPluginAudioProcessorEditor final : public juce::AudioProcessorEditor
+class AudioPluginAudioProcessorEditor final : public juce::AudioProcessorEditor, private juce::Timer
 {
 public:
     explicit AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor&);
@@ -14,14 +15,33 @@ public:
     void resized() override;
 
 private:
+    void timerCallback() override;
+    void updateControls();
+    void showClickKitMenu();
+    void updateClickKitButton();
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     AudioPluginAudioProcessor& processorRef;
 
+    BeatIndicator beatIndicator { processorRef.beatEvents };
     juce::TextButton playStopButton { "Play" };
     juce::Slider bpm { "BPM" };
     juce::Label timeSignatureNumerator { "Time Signature Numerator", "4" };
     juce::Label timeSignatureDenominator { "Time Signature Denominator", "4" };
+    juce::ToggleButton hostSyncButton { "Sync to host" };
+    juce::ToggleButton synthClickButton { "Synth click" };
+    juce::ToggleButton midiOutputButton { "MIDI out" };
+    juce::TextButton clickKitButton { "Built-in clicks" };
+    std::unique_ptr<juce::FileChooser> clickKitChooser;
+    juce::ComboBox subdivision { "Subdivision" };
+    juce::Label beatGrouping { "Beat Grouping", "No grouping" };
+    juce::Label lookAhead { "Look-ahead", "" };
+    std::array<juce::TextButton, PresetBank::NUM_PRESETS> presetButtons;
+    juce::ToggleButton analyseInputButton { "Analyse input" };
+    juce::Label timingLatency { "Timing Latency", "" };
+    juce::Label timingStats { "Timing Stats", "" };
+    juce::Label audioThreadStats { "Audio Thread Stats", "" };
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessorEditor)
 };
@@ -9,9 +9,13 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
                           .withInput ("Input", juce::AudioChannelSet::stereo(), true)
 #endif
                           .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
+                          .withOutput ("Downbeats", juce::AudioChannelSet::stereo(), false)
+                          .withOutput ("Beats", juce::AudioChannelSet::stereo(), false)
+                          .withOutput ("Subdivisions", juce::AudioChannelSet::stereo(), false)
 #endif
       )
 {
+    snapshots.publish (MetronomeSnapshot::make (settings));
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor() = default;
@@ -88,13 +92,33 @@ void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
     if (channels == 0)
         return;
 
+    // The audio callback isn't running here, so catch up on any commands sent while it was stopped (the queue may
+    // even have filled up and dropped some), and on the latest settings.
+    applyPendingCommands();
+    metronomeIsPlaying = isPlaying;
+    snapshots.update();
+
     metronome.prepareToPlay (sampleRate, samplesPerBlock);
+    metronome.applySnapshot (*snapshots.getCurrent()); // the look-ahead depends on the sample rate
+    clickKitLoader.prepareToPlay (metronome, sampleRate);
+    timingAnalyzer.prepare (sampleRate);
+    updateLatency (snapshots.getCurrent()->settings);
+
+    // Enough for a note on and off on every sample of the block, plus clock
+    spareMidiBuffer.clear();
+    spareMidiBuffer.ensureSize (static_cast<size_t> (samplesPerBlock + 64) * 32);
+    reservedMidiStorage = spareMidiBuffer.data.begin();
+
+    // The budget per block may have changed, so start measuring afresh
+    audioThreadStats.requestReset();
 }
 
 void AudioPluginAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    if (AudioThreadStats::IS_ENABLED)
+        juce::Logger::writeToLog ("Metronome audio thread stats\n" + audioThreadStats.getSnapshot().toString());
 }
 
 bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
@@ -117,6 +141,14 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
         return false;
 #endif
 
+    // Each stem's output can be turned off, which plays its clicks through the main output again
+    for (int bus = 1; bus < layouts.outputBuses.size(); ++bus)
+    {
+        const auto stemChannels = layouts.getChannelSet (false, bus);
+        if (! stemChannels.isDisabled() && stemChannels != juce::AudioChannelSet::mono() && stemChannels != juce::AudioChannelSet::stereo())
+            return false;
+    }
+
     return true;
 #endif
 }
@@ -124,8 +156,27 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
 void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
                                               juce::MidiBuffer& midiMessages)
 {
-    juce::ignoreUnused (midiMessages);
+    processSamples (buffer, midiMessages);
+}
+
+// Hosts that mix in double precision hand us their buffers directly, rather than converting to float and back around
+// every block. The metronome renders its float clicks straight into them.
+void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer,
+                                              juce::MidiBuffer& midiMessages)
+{
+    processSamples (buffer, midiMessages);
+}
+
+bool AudioPluginAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
 
+template <typename SampleType>
+void AudioPluginAudioProcessor::processSamples (juce::AudioBuffer<SampleType>& buffer,
+                                                juce::MidiBuffer& midiMessages)
+{
+    const AudioThreadStats::ScopedBlockTimer blockTimer (audioThreadStats, buffer.getNumSamples(), getSampleRate());
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -139,28 +190,83 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    // Instead of using our own playback, BPM, and time signature state, we could sync to DAW using:
-    // auto position = getPlayHead()->getPosition();
-    // position->getTimeInSamples();
-    // position->getTimeSignature();
+    // Commands and new settings apply at the start of the block, so the DAW-synced path also sees the latest settings.
+    // Settings arrive as a whole snapshot, so a preset's tempo and time signature always start on the same pulse.
+    // When synced to the DAW, we use the host's playback, BPM, and time signature state instead of our own.
     //
     // PPQ means "parts/pulses per quarter note" and is used in the context of MIDI to represent
     // the quantization resolution of a MIDI sequencer or MIDI file. JUCE uses "PPQ" in the following
     // 2 function names, but this is a misnomer, really they mean "the number of quarter notes since".
     // These functions return the number of quarter notes as a continuous number. So 2.5 means
     // two and a half quarter notes.
-    // position->getPpqPositionOfLastBarStart();
-    // position->getPpqPosition();
+    // The metronome lines its beats up with position->getPpqPosition() and position->getPpqPositionOfLastBarStart().
     //
-    // position->getBarCount();
+    // MIDI notes and clock, if enabled, are added to `midiMessages` on the same samples as the clicks.
+    applyPendingCommands();
+    if (snapshots.update())
+        metronome.applySnapshot (*snapshots.getCurrent());
+
+    // Hosts hand over the same MIDI buffer every block, but it may not have room for the notes and clock we add, e.g.
+    // a new, empty one. The first block swaps the storage reserved in `prepareToPlay()` into it, keeping any events
+    // the host put there, so from then on adding our messages never allocates.
+    if (midiMessages.data.begin() != reservedMidiStorage && spareMidiBuffer.data.begin() == reservedMidiStorage)
+    {
+        spareMidiBuffer.addEvents (midiMessages, 0, -1, 0);
+        midiMessages.swapWith (spareMidiBuffer);
+    }
+
+    const auto blockStartTime = samplesRendered;
+    samplesRendered += buffer.getNumSamples();
+
+    const auto* playHead = snapshots.getCurrent()->settings.syncToHost ? getPlayHead() : nullptr;
+    const auto position = playHead != nullptr ? playHead->getPosition() : juce::Optional<juce::AudioPlayHead::PositionInfo>();
+    if (! position.hasValue() && ! metronomeIsPlaying)
+    {
+        barNumber = 0;
+        metronome.stopMidi (midiMessages, buffer.getNumSamples());
+        return;
+    }
+
+    // A newly loaded click kit takes over between blocks
+    clickKitLoader.update (metronome, buffer.getNumSamples());
+
+    // The player's input is still in the buffer until the clicks are added to it
+    timingAnalyzer.analyseInput (buffer, totalNumInputChannels, blockStartTime);
+
+    // Each stem renders straight into its own bus's channels of the host's buffer, with nothing mixed or copied
+    // afterwards. Stems whose bus is off play through the main output, so with none on it's a single output as before.
+    auto mainOutput = getBusBuffer (buffer, false, 0);
+    Metronome::StemBuffers<SampleType> outputs { &mainOutput, &mainOutput, &mainOutput };
+    std::array<juce::AudioBuffer<SampleType>, Metronome::NUM_STEMS> stemOutputs;
+    for (size_t stem = 0; stem < outputs.size(); ++stem)
+    {
+        const int bus = static_cast<int> (stem) + 1;
+        if (getChannelCountOfBus (false, bus) > 0)
+        {
+            stemOutputs[stem].setDataToReferTo (buffer.getArrayOfWritePointers() + getChannelIndexInProcessBlockBuffer (false, bus, 0),
+                                                getChannelCountOfBus (false, bus),
+                                                buffer.getNumSamples());
+            outputs[stem] = &stemOutputs[stem];
+        }
+    }
 
-    if (isPlaying)
+    if (position.hasValue())
     {
-        metronome.setBPM (bpm.load());
-        metronome.setTimeSignature ({ { timeSigNumerator }, { timeSigDenominator } });
-        metronome.process (buffer);
+        if (! position->getIsPlaying())
+            barNumber = 0;
+
+        metronome.processHostSynced (outputs, *position, &midiMessages);
+    }
+    else
+    {
+        metronome.process (outputs, &midiMessages);
     }
 
+    sendBeatEvents (blockStartTime, buffer.getNumSamples());
+    timingAnalyzer.addClicks (metronome, blockStartTime);
+
+    audioThreadStats.addActivity (metronome.getNumBeatsInLastBlock(), metronome.getNumActiveVoices());
+
     // This is the place where you'd normally do the guts of your plugin's
     // audio processing...
     // Make sure to reset the state if your inner loop is processing
@@ -190,17 +296,41 @@ juce::AudioProcessorEditor* AudioPluginAudioProcessor::createEditor()
 //==============================================================================
 void AudioPluginAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
-    juce::ignoreUnused (destData);
+    juce::MemoryOutputStream stream (destData, false);
+    stream.writeInt (STATE_MAGIC);
+    stream.writeByte (static_cast<char> (MetronomeSettings::FORMAT_VERSION));
+
+    {
+        const juce::ScopedLock lock (settingsLock);
+        settings.writeTo (stream);
+        presets.writeTo (stream);
+    }
+
+    stream.writeString (getClickKitFolder().getFullPathName());
 }
 
 void AudioPluginAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
-    juce::ignoreUnused (data, sizeInBytes);
+    juce::MemoryInputStream stream (data, static_cast<size_t> (std::max (sizeInBytes, 0)), false);
+    if (stream.getNumBytesRemaining() < 5 || stream.readInt() != STATE_MAGIC)
+        return;
+
+    // Nothing changes unless the whole state reads back, so a damaged session keeps the defaults
+    const int version = stream.readByte();
+    const auto newSettings = MetronomeSettings::readFrom (stream, version);
+    PresetBank newPresets;
+    if (! newSettings.has_value() || ! newPresets.readFrom (stream, version))
+        return;
+
+    const auto kitFolder = stream.readString();
+
+    {
+        const juce::ScopedLock lock (settingsLock);
+        presets = newPresets;
+    }
+
+    setSettings (*newSettings);
+    loadClickKit (juce::File::isAbsolutePath (kitFolder) ? juce::File (kitFolder) : juce::File());
 }
 
 //==============================================================================
@@ -212,16 +342,178 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 
 void AudioPluginAudioProcessor::togglePlayback()
 {
-    // TODO: We really want this whole operation to be atomic, but right now it is not.
-    // Metronome could be playing on the audio thread while its data is being reset if it was
-    // still in the middle of an audio callback that had isPlaying == true.
-    // Ideally, we would use a lock free queue of messages.
-    //
-    // Or we could use a try lock so the audio thread could acquire or pass a lock quick
-    // like JUCE example `WebViewPluginDemo.h`
-    // const SpinLock::ScopedTryLockType lock (spectrumDataLock);
-
+    // The metronome may be in the middle of an audio callback, so rather than resetting it from here we queue
+    // the change and let the audio thread apply it at the start of its next block.
+    // A lock free queue means neither thread ever waits on the other, unlike a try lock which only hides the problem.
+    // The queue takes one producer at a time, and a host may be restoring state from another thread right now.
+    const juce::ScopedLock lock (settingsLock);
     isPlaying = ! isPlaying;
-    if (! isPlaying)
-        metronome.reset();
+    commandQueue.push ({ isPlaying ? MetronomeCommand::Type::start : MetronomeCommand::Type::stop });
+}
+
+void AudioPluginAudioProcessor::setSettings (const MetronomeSettings& newSettings)
+{
+    {
+        const juce::ScopedLock lock (settingsLock);
+        resetIfLeavingHostSync (newSettings);
+        settings = newSettings;
+
+        // Built here, pattern and all, so the audio thread only swaps a pointer. Changing several settings at once
+        // this way means the audio thread can never play some of them without the others.
+        snapshots.publish (MetronomeSnapshot::make (newSettings));
+    }
+
+    updateLatency (newSettings);
+}
+
+void AudioPluginAudioProcessor::setBPM (const double newBpm)
+{
+    auto newSettings = getSettings();
+    newSettings.bpm = newBpm;
+    setSettings (newSettings);
+}
+
+void AudioPluginAudioProcessor::setTimeSignature (const TimeSignature newTimeSignature)
+{
+    auto newSettings = getSettings();
+    newSettings.timeSignature = newTimeSignature;
+    setSettings (newSettings);
+}
+
+void AudioPluginAudioProcessor::setClickSound (const ClickSound newClickSound)
+{
+    auto newSettings = getSettings();
+    newSettings.clickSound = newClickSound;
+    setSettings (newSettings);
+}
+
+void AudioPluginAudioProcessor::setRhythmPattern (const RhythmPattern& newRhythmPattern)
+{
+    auto newSettings = getSettings();
+    newSettings.rhythmPattern = newRhythmPattern;
+    setSettings (newSettings);
+}
+
+void AudioPluginAudioProcessor::setMidiOutput (const MidiClickOutput::Settings& newMidiOutput)
+{
+    auto newSettings = getSettings();
+    newSettings.midiOutput = newMidiOutput;
+    setSettings (newSettings);
+}
+
+void AudioPluginAudioProcessor::setSyncToHost (const bool shouldSyncToHost)
+{
+    auto newSettings = getSettings();
+    newSettings.syncToHost = shouldSyncToHost;
+    setSettings (newSettings);
+}
+
+void AudioPluginAudioProcessor::setLookAhead (const double newLookAheadSeconds)
+{
+    auto newSettings = getSettings();
+    newSettings.lookAheadSeconds = juce::jlimit (0.0, MetronomeSettings::MAX_LOOK_AHEAD_SECONDS, newLookAheadSeconds);
+    setSettings (newSettings);
+}
+
+MetronomeSettings AudioPluginAudioProcessor::getSettings() const
+{
+    const juce::ScopedLock lock (settingsLock);
+    return settings;
+}
+
+void AudioPluginAudioProcessor::storePreset (const int index)
+{
+    const juce::ScopedLock lock (settingsLock);
+    presets.store (index, settings);
+}
+
+bool AudioPluginAudioProcessor::recallPreset (const int index)
+{
+    std::shared_ptr<const MetronomeSnapshot> preset;
+    {
+        const juce::ScopedLock lock (settingsLock);
+        preset = presets.get (index);
+        if (preset == nullptr)
+            return false;
+
+        resetIfLeavingHostSync (preset->settings);
+
+        // The preset's snapshot was built when it was stored, so switching during a show allocates and compiles nothing
+        settings = preset->settings;
+        snapshots.publish (preset);
+    }
+
+    updateLatency (preset->settings);
+    return true;
+}
+
+bool AudioPluginAudioProcessor::hasPreset (const int index) const
+{
+    const juce::ScopedLock lock (settingsLock);
+    return presets.get (index) != nullptr;
+}
+
+void AudioPluginAudioProcessor::loadClickKit (const juce::File& folder)
+{
+    // Files are read and resampled on the loader's thread, which hands the finished kit to the audio thread
+    clickKitLoader.load (folder);
+}
+
+juce::File AudioPluginAudioProcessor::getClickKitFolder() const
+{
+    return clickKitLoader.getFolder();
+}
+
+void AudioPluginAudioProcessor::updateLatency (const MetronomeSettings& latestSettings)
+{
+    // Only the host can play our output early, and only when it knows our latency. Without it there's no timeline to
+    // line the MIDI up with, so the look-ahead just keeps the clicks ahead of the MIDI.
+    const auto lookAheadSamples = static_cast<int> (std::lround (latestSettings.lookAheadSeconds * getSampleRate()));
+    setLatencySamples (latestSettings.syncToHost ? lookAheadSamples : 0);
+}
+
+void AudioPluginAudioProcessor::resetIfLeavingHostSync (const MetronomeSettings& newSettings)
+{
+    // The metronome's own clock stood still while it followed the host, so when it stops following while playing, it
+    // restarts on a downbeat rather than carrying on from wherever it was left. The reset goes ahead of the new
+    // settings, so the audio thread never plays a block from the stale clock. Called with `settingsLock` held.
+    if (settings.syncToHost && ! newSettings.syncToHost && isPlaying)
+        commandQueue.push ({ MetronomeCommand::Type::reset });
+}
+
+void AudioPluginAudioProcessor::sendBeatEvents (const juce::int64 blockStartTime, const int numSamples) noexcept
+{
+    // Bars are counted even with no one listening, so the count is right when the editor opens
+    const bool isListening = beatEvents.isListening();
+    if (isListening)
+        beatEvents.startBlock (blockStartTime, getSampleRate(), numSamples + getLatencySamples()); // heard after the block playing now
+
+    for (const auto& beat : metronome.getBeatsInLastBlock())
+    {
+        if (beat.pulseInBar == 0)
+            ++barNumber;
+
+        if (isListening)
+            beatEvents.push ({ blockStartTime + beat.samplePosition, std::max (barNumber, 1), beat.pulseInBar / beat.pulsesPerBeat, beat.beatsPerBar, beat.accent });
+    }
+}
+
+void AudioPluginAudioProcessor::applyPendingCommands() noexcept
+{
+    commandQueue.drain ([this] (const MetronomeCommand& command)
+                        {
+                            switch (command.type)
+                            {
+                                case MetronomeCommand::Type::start:
+                                    metronomeIsPlaying = true;
+                                    break;
+                                case MetronomeCommand::Type::stop:
+                                    metronomeIsPlaying = false;
+                                    metronome.reset();
+                                    break;
+                                case MetronomeCommand::Type::reset:
+                                    metronome.reset();
+                                    break;
+                            }
+                        });
 }
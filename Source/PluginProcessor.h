@@ -1,6 +1,14 @@
 #pragma once
 
+#include "AudioThreadStats.h"
+#include "BeatEventQueue.h"
+#include "ClickKitLoader.h"
 #include "Metronome.h"
+#include "MetronomeCommandQueue.h"
+#include "MetronomeSettings.h"
+#include "PresetBank.h"
+#include "SnapshotExchange.h"
+#include "TimingAnalyzer.h"
 #include <atomic>
 #include <juce_audio_processors/juce_audio_processors.h>
 
@@ -19,7 +27,8 @@ public:
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
-    using AudioProcessor::processBlock;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -44,17 +53,71 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
+    // Message thread only. Playing and stopping are sent to the audio thread as commands, and settings as whole
+    // snapshots, so the metronome is only ever touched there.
     void togglePlayback();
+    void setSettings (const MetronomeSettings& newSettings);
+    void setBPM (double newBpm);
+    void setTimeSignature (TimeSignature newTimeSignature);
+    void setClickSound (ClickSound newClickSound);
+    void setRhythmPattern (const RhythmPattern& newRhythmPattern);
+    void setMidiOutput (const MidiClickOutput::Settings& newMidiOutput);
+    void setSyncToHost (bool shouldSyncToHost);
+    void setLookAhead (double newLookAheadSeconds);
+    void loadClickKit (const juce::File& folder); // juce::File() for the embedded clicks
+    [[nodiscard]] juce::File getClickKitFolder() const;
+
+    // Message thread only. Setlist presets, see `PresetBank`.
+    void storePreset (int index);
+    bool recallPreset (int index); // false if nothing's stored there
+    [[nodiscard]] bool hasPreset (int index) const;
+
+    /// Any thread but the audio thread. The settings last set, which the audio thread picks up at its next block.
+    [[nodiscard]] MetronomeSettings getSettings() const;
+
+    // The message thread's view of the transport, e.g. for the editor to show.
+    // The audio thread keeps its own copy, updated from `commandQueue`.
     std::atomic<bool> isPlaying = false;
-    std::atomic<double> bpm = 120.0;
 
-    // Instead of using std::atomic<TimeSignature> we split the internals of this struct because
-    // std::atomic<structs> are not guarunteed to be lock free.
-    std::atomic<int> timeSigNumerator = 4;
-    std::atomic<int> timeSigDenominator = 4;
+    // Timing of the audio callback, written by the audio thread and safe to read from any thread.
+    AudioThreadStats audioThreadStats;
+
+    // Every click played, for the editor's beat indicator. Only filled while the editor is listening.
+    BeatEventQueue beatEvents;
+
+    // How the player's hits on the input line up with the clicks. Off until the editor turns it on.
+    TimingAnalyzer timingAnalyzer;
 
 private:
+    template <typename SampleType>
+    void processSamples (juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages);
+    void applyPendingCommands() noexcept;
+    void sendBeatEvents (juce::int64 blockStartTime, int numSamples) noexcept;
+    void updateLatency (const MetronomeSettings& latestSettings);
+    void resetIfLeavingHostSync (const MetronomeSettings& newSettings);
+
+    // Saved state: a magic number, a format version for `MetronomeSettings::readFrom()`, the settings, the presets and
+    // the click kit's folder
+    static constexpr int STATE_MAGIC = 0x4e52544d; // "MTRN" in little-endian
+
+    // Any thread but the audio thread, as hosts may save and restore state from their own threads. Also held while
+    // pushing to `commandQueue`, as that only takes one producer at a time.
+    juce::CriticalSection settingsLock;
+    MetronomeSettings settings;
+    PresetBank presets;
+    SnapshotExchange<MetronomeSnapshot> snapshots; // built from `settings`, and picked up by the audio thread
+
+    ClickKitLoader clickKitLoader; // declared before the metronome, so it outlives the metronome playing its kits
     Metronome metronome;
+    MetronomeCommandQueue commandQueue;
+    bool metronomeIsPlaying = false; // audio thread's copy of `isPlaying`
+    juce::int64 samplesRendered = 0; // audio thread only, the clock for `beatEvents`
+
+    // Room for a whole block of MIDI notes and clock, swapped into the host's MIDI buffer in the first block after
+    // `prepareToPlay()`, see `processSamples()`
+    juce::MidiBuffer spareMidiBuffer;
+    const juce::uint8* reservedMidiStorage = nullptr;
+    int barNumber = 0; // audio thread only, bars since the metronome started, or 0 while it's stopped
 
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessor)
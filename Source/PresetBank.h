@@ -0,0 +1,79 @@
+#pragma once
+
+#include "MetronomeSettings.h"
+#include <array>
+#include <memory>
+
+/// Numbered presets for a setlist, each a whole `MetronomeSettings`.
+///
+/// Every preset is kept as a ready-made `MetronomeSnapshot`, so recalling one mid-show allocates and compiles nothing:
+/// the same snapshot is handed to the audio thread again. Message thread only.
+class PresetBank
+{
+public:
+    static constexpr int NUM_PRESETS = 8;
+
+    void store (const int index, const MetronomeSettings& settings)
+    {
+        if (isValidIndex (index))
+            presets[static_cast<size_t> (index)] = MetronomeSnapshot::make (settings);
+    }
+
+    void clear (const int index)
+    {
+        if (isValidIndex (index))
+            presets[static_cast<size_t> (index)] = nullptr;
+    }
+
+    /// The preset at `index`, or null if nothing's been stored there.
+    [[nodiscard]] std::shared_ptr<const MetronomeSnapshot> get (const int index) const
+    {
+        return isValidIndex (index) ? presets[static_cast<size_t> (index)] : nullptr;
+    }
+
+    /// Writes a byte with a bit set for each stored preset, then their settings in order.
+    void writeTo (juce::OutputStream& stream) const
+    {
+        static_assert (NUM_PRESETS <= 8, "the stored presets must fit in one byte");
+
+        int stored = 0;
+        for (size_t index = 0; index < presets.size(); ++index)
+            if (presets[index] != nullptr)
+                stored |= 1 << index;
+
+        stream.writeByte (static_cast<char> (stored));
+        for (const auto& preset : presets)
+            if (preset != nullptr)
+                preset->settings.writeTo (stream);
+    }
+
+    /// Reads presets written by `writeTo()` in settings format `version`. Returns false, and leaves the bank as it was,
+    /// if any of them can't be read.
+    bool readFrom (juce::InputStream& stream, const int version)
+    {
+        if (stream.isExhausted())
+            return false;
+
+        const auto stored = static_cast<uint8_t> (stream.readByte());
+        decltype (presets) newPresets;
+        for (size_t index = 0; index < newPresets.size(); ++index)
+        {
+            if ((stored & (1 << index)) == 0)
+                continue;
+
+            const auto settings = MetronomeSettings::readFrom (stream, version);
+            if (! settings.has_value())
+                return false;
+
+            newPresets[index] = MetronomeSnapshot::make (*settings);
+        }
+
+        presets = std::move (newPresets);
+        return true;
+    }
+
+private:
+    [[nodiscard]] static bool isValidIndex (const int index) noexcept { return index >= 0 && index < NUM_PRESETS; }
+
+    std::array<std::shared_ptr<const MetronomeSnapshot>, NUM_PRESETS> presets;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "SpscQueue.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+/// Keeps objects the audio thread plays from, e.g. `MetronomeSnapshot`s or click sample sets, alive until the audio
+/// thread retires them, and frees them on another thread.
+///
+/// The owning thread hands the audio thread plain pointers from `own()`. When the audio thread is done with one, it
+/// passes it back through `retire()`, which is wait-free, and the owning thread lets go of it on its next `collect()`.
+/// The audio thread never locks, allocates or frees. An object may be owned more than once, e.g. a preset recalled
+/// twice, and is freed once each of them has been retired or disowned.
+template <typename Object, int RetiredCapacity>
+class RetiredOwners
+{
+public:
+    /// Owning thread only. Keeps `object` alive until it's passed back, and returns the pointer to hand out.
+    const Object* own (std::shared_ptr<const Object> object)
+    {
+        owners.push_back (std::move (object));
+        return owners.back().get();
+    }
+
+    /// Owning thread only. Lets go of one reference from `own()`, e.g. for an object the audio thread never picked up.
+    void disown (const Object* object)
+    {
+        const auto owner = std::find_if (owners.begin(), owners.end(), [object] (const auto& ownedObject)
+                                         { return ownedObject.get() == object; });
+        if (owner != owners.end())
+            owners.erase (owner);
+    }
+
+    /// Owning thread only. Lets go of everything the audio thread has retired.
+    void collect()
+    {
+        retired.drain ([this] (const Object* object)
+                       { disown (object); });
+    }
+
+    /// Owning thread only. How many references from `own()` are still held.
+    [[nodiscard]] size_t getNumOwned() const noexcept { return owners.size(); }
+
+    /// Audio thread only, or while it's stopped. Passes `object` back once the audio thread is done with it. Returns
+    /// false if the FIFO is full, e.g. while the owning thread isn't collecting, in which case try again later.
+    bool retire (const Object* object) noexcept { return retired.push (object); }
+
+private:
+    // Owning thread only
+    std::vector<std::shared_ptr<const Object>> owners; // one per `own()` not yet retired or disowned
+
+    // Audio thread to owning thread
+    SpscQueue<const Object*, RetiredCapacity> retired;
+};
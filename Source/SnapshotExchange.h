@@ -0,0 +1,71 @@
+#pragma once
+
+#include "RetiredOwners.h"
+#include <atomic>
+#include <juce_core/juce_core.h>
+#include <memory>
+
+/// Hands immutable snapshots, e.g. `MetronomeSnapshot`s, from the message thread to the audio thread whole.
+///
+/// The message thread publishes a snapshot with one atomic pointer exchange, and the audio thread picks up the newest
+/// at the start of a block with another, so it never sees half of a change. The message thread keeps every snapshot
+/// it published alive until the audio thread has passed it back through a wait-free FIFO, and frees it on its next
+/// publish or `collectGarbage()`. The audio thread never locks, allocates or frees.
+///
+/// A snapshot may be published more than once, e.g. a preset recalled twice, and each publish is passed back once.
+template <typename Snapshot>
+class SnapshotExchange
+{
+public:
+    /// Message thread only. Makes `snapshot` the next one the audio thread picks up. If the audio thread never picked
+    /// up the one before, it's skipped.
+    void publish (std::shared_ptr<const Snapshot> snapshot)
+    {
+        jassert (snapshot != nullptr);
+        collectGarbage();
+
+        if (const auto* unpicked = pending.exchange (owners.own (std::move (snapshot))))
+            owners.disown (unpicked);
+    }
+
+    /// Message thread only. Frees the snapshots the audio thread has passed back.
+    void collectGarbage() { owners.collect(); }
+
+    /// Audio thread only, or while it's stopped. Switches to the newest snapshot published since the last call, and
+    /// returns true if there was one. Wait-free.
+    bool update() noexcept
+    {
+        if (retiring != nullptr && owners.retire (retiring))
+            retiring = nullptr;
+
+        // The FIFO only fills up if the message thread stops collecting, so hold on to the new snapshot until then
+        if (retiring != nullptr)
+            return false;
+
+        const auto* next = pending.exchange (nullptr);
+        if (next == nullptr)
+            return false;
+
+        if (current != nullptr && ! owners.retire (current))
+            retiring = current;
+
+        current = next;
+        return true;
+    }
+
+    /// Audio thread only. The snapshot picked up last, or null before the first `update()` that found one.
+    [[nodiscard]] const Snapshot* getCurrent() const noexcept { return current; }
+
+private:
+    static constexpr int RETIRED_CAPACITY = 64;
+
+    // Message thread, and the audio thread passing snapshots back
+    RetiredOwners<Snapshot, RETIRED_CAPACITY> owners; // one per publish the audio thread hasn't passed back
+
+    // Message thread to audio thread
+    std::atomic<const Snapshot*> pending { nullptr };
+
+    // Audio thread only
+    const Snapshot* current = nullptr;
+    const Snapshot* retiring = nullptr; // switched away from, but the FIFO was full
+};
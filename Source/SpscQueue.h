@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <juce_core/juce_core.h>
+
+/// Bounded single-producer single-consumer FIFO of `Item`s, for passing small values between the audio thread and
+/// another thread, e.g. `MetronomeCommand`s, `BeatEvent`s or retired pointers.
+///
+/// Both ends are wait-free: they only touch the preallocated ring and `juce::AbstractFifo`'s atomic indices, so neither
+/// thread ever blocks on (or gets priority-inverted by) the other, and neither allocates. Holds up to `Capacity - 1`
+/// items.
+template <typename Item, int Capacity>
+class SpscQueue
+{
+public:
+    /// Producer only. Returns false if the queue is full, in which case `item` is dropped.
+    bool push (const Item& item) noexcept
+    {
+        const auto scope = fifo.write (1);
+        if (scope.blockSize1 + scope.blockSize2 != 1)
+            return false;
+
+        items[static_cast<size_t> (scope.blockSize1 == 1 ? scope.startIndex1 : scope.startIndex2)] = item;
+        return true;
+    }
+
+    /// Consumer only. Takes the oldest item, or returns false if there are none.
+    bool pop (Item& item) noexcept
+    {
+        const auto scope = fifo.read (1);
+        if (scope.blockSize1 + scope.blockSize2 != 1)
+            return false;
+
+        item = items[static_cast<size_t> (scope.blockSize1 == 1 ? scope.startIndex1 : scope.startIndex2)];
+        return true;
+    }
+
+    /// Consumer only. Takes every item waiting, calling `function` with each, oldest first.
+    template <typename Function>
+    void drain (Function&& function)
+    {
+        auto scope = fifo.read (fifo.getNumReady());
+        scope.forEach ([this, &function] (const int index)
+                       { function (items[static_cast<size_t> (index)]); });
+    }
+
+    /// Consumer only. Throws away every item waiting.
+    void clear() noexcept { fifo.finishedRead (fifo.getNumReady()); }
+
+private:
+    juce::AbstractFifo fifo { Capacity };
+    std::array<Item, Capacity> items {};
+};
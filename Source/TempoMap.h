@@ -0,0 +1,200 @@
+#pragma once
+
+#include "TimeSignature.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <juce_core/juce_core.h>
+#include <limits>
+
+/// A list of tempo and time signature changes over bars, e.g. for an accelerando, a ritardando or a speed trainer.
+///
+/// Each change takes effect at the start of its bar. Its curve says how the tempo gets there from the previous change:
+/// a step jumps at the bar line, while a linear or exponential ramp glides there over the bars in between.
+/// The tempo after the last change stays constant.
+///
+/// `prepare()` turns the changes into segments, each with a closed-form integral of its tempo curve, so the position of
+/// any pulse is evaluated straight from its index instead of stepping through the samples or pulses before it.
+/// Every pulse is rounded to a sample on its own, so rounding never builds up into drift however long the map plays.
+/// Fixed size and trivially copyable, so it can be handed to the audio thread without allocating.
+class TempoMap
+{
+public:
+    enum class Curve : uint8_t
+    {
+        step,
+        linear, // the tempo changes by the same amount every beat
+        exponential // the tempo changes by the same ratio every beat
+    };
+
+    struct Change
+    {
+        int bar = 0; // bars since the start of the map
+        double bpm = 120.0;
+        TimeSignature timeSignature = { { 4 }, { 4 } };
+        Curve curve = Curve::step; // how the tempo gets from the previous change to this one
+    };
+
+    /// A run of pulses between two changes, with one time signature and one tempo curve.
+    struct Segment
+    {
+        TimeSignature timeSignature;
+        double startPosition = 0.0; // samples since the start of the map
+        juce::int64 numPulses = 0; // unbounded for the last segment
+        double samplesPerPulse = 0.0; // at the start of the segment
+        double rate = 0.0; // change of tempo per pulse, see `getPulsePosition()`
+        Curve curve = Curve::step;
+    };
+
+    static constexpr int MAX_CHANGES = 32;
+
+    /// Appends a change. Changes must be added in bar order, starting at bar 0.
+    /// Returns false, leaving the map as it was, if the map is full or the change is out of order or invalid.
+    bool addChange (const Change& change) noexcept
+    {
+        const bool isInOrder = numChanges == 0 ? change.bar == 0 : change.bar > changes[static_cast<size_t> (numChanges - 1)].bar;
+        const bool isValid = change.bpm > 0.0 && change.timeSignature.numerator > 0 && change.timeSignature.denominator > 0;
+        if (numChanges == MAX_CHANGES || ! isInOrder || ! isValid)
+            return false;
+
+        changes[static_cast<size_t> (numChanges++)] = change;
+        numSegments = 0;
+        return true;
+    }
+
+    void clear() noexcept
+    {
+        numChanges = 0;
+        numSegments = 0;
+    }
+
+    [[nodiscard]] bool isEmpty() const noexcept { return numChanges == 0; }
+    [[nodiscard]] int getNumChanges() const noexcept { return numChanges; }
+    [[nodiscard]] const Change& getChange (const int index) const noexcept { return changes[static_cast<size_t> (index)]; }
+
+    /// Compiles the changes into segments for `sampleRate`, with `pulsesPerBeat` clicks per beat.
+    void prepare (const double sampleRate, const int pulsesPerBeat) noexcept
+    {
+        jassert (sampleRate > 0.0 && pulsesPerBeat > 0);
+
+        double startPosition = 0.0;
+        for (int index = 0; index < numChanges; ++index)
+        {
+            const auto& change = changes[static_cast<size_t> (index)];
+            auto& segment = segments[static_cast<size_t> (index)];
+
+            segment.timeSignature = change.timeSignature;
+            segment.startPosition = startPosition;
+            segment.samplesPerPulse = 60.0 / change.bpm * (4.0 / change.timeSignature.denominator) * sampleRate / pulsesPerBeat;
+            segment.numPulses = std::numeric_limits<juce::int64>::max();
+            segment.curve = Curve::step;
+            segment.rate = 0.0;
+
+            if (index + 1 < numChanges)
+            {
+                const auto& next = changes[static_cast<size_t> (index + 1)];
+                segment.numPulses = static_cast<juce::int64> (next.bar - change.bar) * change.timeSignature.numerator * pulsesPerBeat;
+
+                const double tempoRatio = next.bpm / change.bpm;
+                if (next.curve != Curve::step && ! juce::exactlyEqual (tempoRatio, 1.0))
+                {
+                    segment.curve = next.curve;
+                    segment.rate = next.curve == Curve::linear ? (tempoRatio - 1.0) / static_cast<double> (segment.numPulses)
+                                                               : std::log (tempoRatio) / static_cast<double> (segment.numPulses);
+                }
+
+                startPosition += getPulsePosition (segment, static_cast<double> (segment.numPulses));
+            }
+        }
+
+        numSegments = numChanges;
+    }
+
+    [[nodiscard]] int getNumSegments() const noexcept { return numSegments; }
+    [[nodiscard]] const Segment& getSegment (const int index) const noexcept { return segments[static_cast<size_t> (index)]; }
+
+    /// Ideal position in samples, since the start of the map, of pulse `pulseIndex` of segment `segmentIndex`.
+    [[nodiscard]] double getPulsePosition (const int segmentIndex, const juce::int64 pulseIndex) const noexcept
+    {
+        const auto& segment = getSegment (segmentIndex);
+        return segment.startPosition + getPulsePosition (segment, static_cast<double> (pulseIndex));
+    }
+
+    struct PulseIndex
+    {
+        int segment = 0;
+        juce::int64 pulse = 0;
+    };
+
+    /// The first pulse that rounds to `samplePosition` (samples since the start of the map) or later.
+    [[nodiscard]] PulseIndex findPulseAt (const juce::int64 samplePosition) const noexcept
+    {
+        jassert (numSegments > 0);
+
+        // Pulses at or after this position round to `samplePosition` or later, the same as `BeatClock::toSampleIndex()`
+        const double threshold = static_cast<double> (samplePosition) - 0.5;
+
+        PulseIndex index;
+        while (index.segment + 1 < numSegments && getSegment (index.segment + 1).startPosition <= threshold)
+            ++index.segment;
+
+        const auto& segment = getSegment (index.segment);
+        const double pulse = std::ceil (getPulseAt (segment, threshold - segment.startPosition));
+        if (! (pulse < static_cast<double> (segment.numPulses))) // also catches a ramp that never gets there
+            return { index.segment + 1, 0 };
+
+        index.pulse = std::max (static_cast<juce::int64> (pulse), juce::int64 { 0 });
+
+        // The inverse is only exact to rounding, so check against the same formula the pulses are played from
+        while (index.pulse > 0 && getPulsePosition (index.segment, index.pulse - 1) >= threshold)
+            --index.pulse;
+        while (getPulsePosition (index.segment, index.pulse) < threshold)
+            ++index.pulse;
+
+        if (index.pulse >= segment.numPulses)
+            return { index.segment + 1, 0 };
+
+        return index;
+    }
+
+private:
+    /// Samples from the start of `segment` to pulse `pulse`, i.e. the integral of samples-per-pulse over the pulses.
+    /// With s = samples per pulse at the start and r = `rate`:
+    /// - step (constant tempo): s * p
+    /// - linear, tempo (1 + r * p) / s: s * ln (1 + r * p) / r
+    /// - exponential, tempo e^(r * p) / s: s * (1 - e^(-r * p)) / r
+    [[nodiscard]] static double getPulsePosition (const Segment& segment, const double pulse) noexcept
+    {
+        switch (segment.curve)
+        {
+            case Curve::linear:
+                return segment.samplesPerPulse * std::log1p (segment.rate * pulse) / segment.rate;
+            case Curve::exponential:
+                return -segment.samplesPerPulse * std::expm1 (-segment.rate * pulse) / segment.rate;
+            case Curve::step:
+            default:
+                return segment.samplesPerPulse * pulse;
+        }
+    }
+
+    /// The inverse of `getPulsePosition()`: the fractional pulse at `position` samples from the start of `segment`.
+    [[nodiscard]] static double getPulseAt (const Segment& segment, const double position) noexcept
+    {
+        const double pulsesAtStartTempo = position / segment.samplesPerPulse;
+        switch (segment.curve)
+        {
+            case Curve::linear:
+                return std::expm1 (segment.rate * pulsesAtStartTempo) / segment.rate;
+            case Curve::exponential:
+                return -std::log1p (-segment.rate * pulsesAtStartTempo) / segment.rate;
+            case Curve::step:
+            default:
+                return pulsesAtStartTempo;
+        }
+    }
+
+    std::array<Change, MAX_CHANGES> changes {};
+    std::array<Segment, MAX_CHANGES> segments {};
+    int numChanges = 0;
+    int numSegments = 0;
+};
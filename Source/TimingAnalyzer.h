@@ -0,0 +1,344 @@
+#pragma once
+
+#include "Metronome.h"
+#include "OnsetDetector.h"
+#include "SpscQueue.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <juce_core/juce_core.h>
+#include <limits>
+#include <vector>
+
+/// How the player's hits line up with the clicks, from `TimingAnalyzer`.
+struct TimingStats
+{
+    static constexpr int MAX_BEATS = 16; // beats in the bar with their own statistics, later beats only count in `all`
+    static constexpr int NUM_HISTOGRAM_BINS = 40;
+    static constexpr double HISTOGRAM_BIN_MS = 5.0; // so the bins span ±100 ms, with further hits in the end bins
+
+    struct Offsets
+    {
+        juce::uint64 numHits = 0;
+        double meanMs = 0.0; // negative when the player is early
+        double jitterMs = 0.0; // standard deviation
+    };
+
+    Offsets all;
+    std::array<Offsets, MAX_BEATS> beats;
+    std::array<std::array<juce::uint32, NUM_HISTOGRAM_BINS>, MAX_BEATS> histograms {}; // of offsets per beat, earliest bin first
+    juce::uint64 numUnmatchedHits = 0; // too far from any click to be meant for one
+    juce::uint64 numDroppedEvents = 0; // lost because the audio thread filled the FIFO
+
+    [[nodiscard]] static int getHistogramBin (const double offsetMs) noexcept
+    {
+        return juce::jlimit (0, NUM_HISTOGRAM_BINS - 1, static_cast<int> (std::floor (offsetMs / HISTOGRAM_BIN_MS)) + NUM_HISTOGRAM_BINS / 2);
+    }
+
+    /// A multi-line report, e.g. for `juce::Logger::writeToLog()` or a file.
+    [[nodiscard]] juce::String toString() const
+    {
+        const auto describe = [] (const Offsets& offsets)
+        {
+            return juce::String (offsets.numHits) + " hits, mean " + juce::String (offsets.meanMs, 1) + " ms, jitter "
+                   + juce::String (offsets.jitterMs, 1) + " ms";
+        };
+
+        juce::String text;
+        text << "All beats: " << describe (all) << ", unmatched hits: " << juce::String (numUnmatchedHits)
+             << ", dropped events: " << juce::String (numDroppedEvents) << "\n"
+             << "Histograms in " << juce::String (HISTOGRAM_BIN_MS, 0) << " ms bins from -"
+             << juce::String (HISTOGRAM_BIN_MS * NUM_HISTOGRAM_BINS / 2, 0) << " ms:\n";
+
+        for (size_t beat = 0; beat < beats.size(); ++beat)
+        {
+            if (beats[beat].numHits == 0)
+                continue;
+
+            text << "  Beat " << juce::String (static_cast<int> (beat) + 1) << ": " << describe (beats[beat]) << "\n   ";
+            for (const auto count : histograms[beat])
+                text << " " << juce::String (count);
+            text << "\n";
+        }
+
+        return text;
+    }
+};
+
+/// Practice analysis: finds the player's hits in the plugin's input and measures how early or late each is against
+/// the click it was meant for.
+///
+/// The audio thread runs an `OnsetDetector` over the input and sends every hit, plus the exact time of every click the
+/// metronome scheduled, through a wait-free FIFO. A hit reaches the input a round trip after the click it was meant for
+/// was rendered, so the round-trip latency set with `setLatency()` is taken off each hit before it's matched. Matching hits to clicks and keeping the statistics happens on the
+/// analyzer's own thread, so the audio thread's cost is fixed per sample and nothing it holds grows, however long the
+/// analysis runs. With the analysis off, the audio thread only loads one atomic per block.
+class TimingAnalyzer final : private juce::Thread
+{
+public:
+    TimingAnalyzer() : juce::Thread ("Timing analyzer")
+    {
+        pendingHits.reserve (MAX_PENDING_HITS);
+        recentClicks.reserve (MAX_RECENT_CLICKS);
+    }
+
+    ~TimingAnalyzer() override { stopThread (1000); }
+
+    /// Message thread only. Starts or stops the analysis, with fresh statistics each time it starts. The analyzer's
+    /// thread only starts the first time the analysis does.
+    void setEnabled (const bool shouldBeEnabled)
+    {
+        if (shouldBeEnabled)
+        {
+            requestReset();
+            if (! isThreadRunning())
+                startThread();
+        }
+
+        enabled = shouldBeEnabled;
+        notify();
+    }
+
+    [[nodiscard]] bool isEnabled() const noexcept { return enabled; }
+
+    /// Message thread only. The round-trip latency: the output latency until the player hears a click, plus the input
+    /// latency until their hit on it comes back into the plugin. Measure it once, e.g. by holding a mic to the speaker
+    /// with this set to 0, when the mean offset is the round trip. Without it, every hit reads that much late.
+    void setLatency (const double seconds) noexcept { latencySeconds = std::max (seconds, 0.0); }
+
+    [[nodiscard]] double getLatency() const noexcept { return latencySeconds; }
+
+    /// Any thread but the audio thread. The analyzer's thread clears the statistics on its next update.
+    void requestReset()
+    {
+        resetRequested = true;
+        notify();
+    }
+
+    /// Any thread but the audio thread. The statistics as of the analyzer's last update, a few times a second.
+    [[nodiscard]] TimingStats getStats() const
+    {
+        const juce::ScopedLock lock (statsLock);
+        return stats;
+    }
+
+    /// Call from `prepareToPlay()`, while the audio thread is stopped.
+    void prepare (const double newSampleRate)
+    {
+        detector.prepare (newSampleRate);
+        sampleRate = newSampleRate;
+    }
+
+    /// Audio thread only. Looks for hits in the first `numInputChannels` of `buffer`, whose first sample is at
+    /// `blockStartTime`. Call before the clicks are added to the same buffer.
+    template <typename SampleType>
+    void analyseInput (const juce::AudioBuffer<SampleType>& buffer, const int numInputChannels, const juce::int64 blockStartTime) noexcept
+    {
+        const bool wasAnalysing = isAnalysing;
+        isAnalysing = enabled;
+        if (! isAnalysing)
+            return;
+
+        if (! wasAnalysing)
+            detector.reset();
+
+        detector.process (buffer, numInputChannels, blockStartTime, [this] (const juce::int64 sampleTime)
+                          { push ({ TimingEvent::Type::hit, static_cast<double> (sampleTime), 0 }); });
+    }
+
+    /// Audio thread only. Sends the clicks `metronome` scheduled in the block at `blockStartTime`, to match hits against.
+    void addClicks (const Metronome& metronome, const juce::int64 blockStartTime) noexcept
+    {
+        if (! isAnalysing)
+            return;
+
+        for (const auto& beat : metronome.getBeatsInLastBlock())
+            push ({ TimingEvent::Type::click,
+                    static_cast<double> (blockStartTime + beat.samplePosition) + beat.subSampleOffset,
+                    beat.pulseInBar / beat.pulsesPerBeat });
+    }
+
+private:
+    static constexpr int FIFO_CAPACITY = 1024;
+    static constexpr size_t MAX_PENDING_HITS = 256;
+    static constexpr double MAX_OFFSET_SECONDS = 0.2; // the furthest a hit can be from its click, however slow the tempo
+    static constexpr size_t MAX_RECENT_CLICKS = 512; // enough to cover a long round trip at the fastest pulses
+    static constexpr int UPDATE_INTERVAL_MS = 50;
+
+    struct TimingEvent
+    {
+        enum class Type : uint8_t
+        {
+            click,
+            hit
+        };
+
+        Type type = Type::click;
+        double sampleTime = 0.0; // on the processor's clock, with clicks to a fraction of a sample
+        int beat = 0; // beat in the bar, from 0, for clicks. Subdivisions share their beat's number.
+    };
+
+    /// Running mean and variance, updated one value at a time so they never need the values kept.
+    struct Accumulator
+    {
+        juce::uint64 count = 0;
+        double mean = 0.0;
+        double sumOfSquaredDeviations = 0.0;
+
+        void add (const double value) noexcept
+        {
+            ++count;
+            const double delta = value - mean;
+            mean += delta / static_cast<double> (count);
+            sumOfSquaredDeviations += delta * (value - mean);
+        }
+
+        [[nodiscard]] TimingStats::Offsets getOffsets() const noexcept
+        {
+            return { count, mean, count > 1 ? std::sqrt (sumOfSquaredDeviations / static_cast<double> (count - 1)) : 0.0 };
+        }
+    };
+
+    void push (const TimingEvent& event) noexcept
+    {
+        if (! events.push (event))
+            numDroppedEvents.fetch_add (1, std::memory_order_relaxed);
+    }
+
+    /// The audio thread can't wake it, so while the analysis is on it collects the events every `UPDATE_INTERVAL_MS`.
+    /// With it off, it sleeps until `setEnabled()` or `requestReset()` wakes it.
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            if (resetRequested.exchange (false))
+                clear();
+
+            events.drain ([this] (const TimingEvent& event)
+                          { handle (event); });
+
+            publish();
+            wait (enabled ? UPDATE_INTERVAL_MS : -1);
+        }
+    }
+
+    /// Events arrive in block order. Each hit is moved back by the round-trip latency, then matched to whichever of the
+    /// first click after it and the one before is closer. Hits come back a round trip late, so the click after one has
+    /// often arrived already, and it's matched straight away. Otherwise it waits for that click.
+    void handle (const TimingEvent& event)
+    {
+        if (event.type == TimingEvent::Type::hit)
+        {
+            const double hitTime = event.sampleTime - latencySeconds.load() * sampleRate.load();
+            if (! recentClicks.empty() && recentClicks.back().sampleTime > hitTime)
+            {
+                const auto nextClick = std::upper_bound (recentClicks.begin(), recentClicks.end(), hitTime, [] (const double time, const TimingEvent& click)
+                                                         { return time < click.sampleTime; });
+                match (hitTime, nextClick == recentClicks.begin() ? nullptr : &*std::prev (nextClick), *nextClick);
+                return;
+            }
+
+            if (pendingHits.size() == MAX_PENDING_HITS)
+            {
+                pendingHits.erase (pendingHits.begin());
+                ++numUnmatchedHits;
+            }
+
+            pendingHits.push_back (hitTime);
+            return;
+        }
+
+        const auto firstLater = std::find_if (pendingHits.begin(), pendingHits.end(), [&event] (const double hitTime)
+                                              { return hitTime > event.sampleTime; });
+        for (auto hit = pendingHits.begin(); hit != firstLater; ++hit)
+            match (*hit, recentClicks.empty() ? nullptr : &recentClicks.back(), event);
+
+        pendingHits.erase (pendingHits.begin(), firstLater);
+
+        if (recentClicks.size() == MAX_RECENT_CLICKS)
+            recentClicks.erase (recentClicks.begin());
+        recentClicks.push_back (event);
+    }
+
+    void match (const double hitTime, const TimingEvent* previousClick, const TimingEvent& nextClick)
+    {
+        const bool isNearerPrevious = previousClick != nullptr && hitTime - previousClick->sampleTime < nextClick.sampleTime - hitTime;
+        const auto& click = isNearerPrevious ? *previousClick : nextClick;
+        const double offset = hitTime - click.sampleTime;
+
+        // Hits halfway between clicks, or long after the last one, weren't meant for either
+        const double rate = sampleRate.load();
+        const double pulseLength = previousClick != nullptr ? nextClick.sampleTime - previousClick->sampleTime : std::numeric_limits<double>::infinity();
+        if (std::abs (offset) > std::min (pulseLength / 2.0, MAX_OFFSET_SECONDS * rate))
+        {
+            ++numUnmatchedHits;
+            return;
+        }
+
+        const double offsetMs = offset * 1000.0 / rate;
+        all.add (offsetMs);
+
+        if (click.beat < TimingStats::MAX_BEATS)
+        {
+            const auto beat = static_cast<size_t> (click.beat);
+            beats[beat].add (offsetMs);
+            ++histograms[beat][static_cast<size_t> (TimingStats::getHistogramBin (offsetMs))];
+        }
+    }
+
+    void clear()
+    {
+        pendingHits.clear();
+        recentClicks.clear();
+        all = {};
+        beats = {};
+        histograms = {};
+        numUnmatchedHits = 0;
+        droppedEventsAtReset = numDroppedEvents.load (std::memory_order_relaxed);
+    }
+
+    void publish()
+    {
+        TimingStats newStats;
+        newStats.all = all.getOffsets();
+        for (size_t beat = 0; beat < beats.size(); ++beat)
+            newStats.beats[beat] = beats[beat].getOffsets();
+        newStats.histograms = histograms;
+        newStats.numUnmatchedHits = numUnmatchedHits;
+        newStats.numDroppedEvents = numDroppedEvents.load (std::memory_order_relaxed) - droppedEventsAtReset;
+
+        const juce::ScopedLock lock (statsLock);
+        stats = newStats;
+    }
+
+    // Message thread to audio and analyzer threads
+    std::atomic<bool> enabled = false;
+    std::atomic<bool> resetRequested = false;
+    std::atomic<double> sampleRate = 44100.0;
+    std::atomic<double> latencySeconds = 0.0;
+
+    // Audio thread only, or `prepare()`
+    OnsetDetector detector;
+    bool isAnalysing = false;
+
+    // Audio thread to analyzer thread
+    SpscQueue<TimingEvent, FIFO_CAPACITY> events;
+    std::atomic<juce::uint64> numDroppedEvents = 0;
+
+    // Analyzer thread only
+    std::vector<double> pendingHits; // times of hits, less the latency, with no click after them yet, oldest first
+    std::vector<TimingEvent> recentClicks; // oldest first, so hits that come back after later clicks can still be matched
+    Accumulator all;
+    std::array<Accumulator, TimingStats::MAX_BEATS> beats;
+    std::array<std::array<juce::uint32, TimingStats::NUM_HISTOGRAM_BINS>, TimingStats::MAX_BEATS> histograms {};
+    juce::uint64 numUnmatchedHits = 0;
+    juce::uint64 droppedEventsAtReset = 0;
+
+    // Analyzer thread to any thread
+    juce::CriticalSection statsLock;
+    TimingStats stats;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TimingAnalyzer)
+};
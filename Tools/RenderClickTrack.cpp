@@ -0,0 +1,73 @@
+// Command line tool to print a click track straight to disk, much faster than playing the Standalone in real time.
+//
+// RenderClickTrack --output=click.wav [--bpm=120] [--time-signature=4/4] [--seconds=60] [--sample-rate=48000]
+//                  [--channels=2] [--bits=24] [--threads=<number of CPUs>]
+//                  [--ramp-to=<bpm> [--ramp-bars=16] [--ramp-curve=linear|exponential]]
+//
+// With `--ramp-to`, the tempo glides from `--bpm` to the given BPM over `--ramp-bars` bars, then holds, e.g. for a
+// speed trainer.
+// The output format is chosen from the file extension, e.g. `.wav` or `.flac`.
+
+#include "OfflineRenderer.h"
+#include <chrono>
+#include <iostream>
+
+int main (int argc, char* argv[])
+{
+    const juce::ArgumentList args (argc, argv);
+
+    const auto outputPath = args.getValueForOption ("--output|-o");
+    if (outputPath.isEmpty())
+    {
+        std::cerr << "Usage: RenderClickTrack --output=click.wav [--bpm=120] [--time-signature=4/4] [--seconds=60]"
+                     " [--sample-rate=48000] [--channels=2] [--bits=24] [--threads=N]"
+                     " [--ramp-to=BPM [--ramp-bars=16] [--ramp-curve=linear|exponential]]"
+                  << std::endl;
+        return 1;
+    }
+
+    auto valueOr = [&args] (const juce::String& option, const double fallback)
+    {
+        const auto value = args.getValueForOption (option);
+        return value.isEmpty() ? fallback : value.getDoubleValue();
+    };
+
+    OfflineRenderer::Settings settings;
+    settings.bpm = std::clamp (valueOr ("--bpm", settings.bpm), 1.0, 10000.0);
+    settings.durationSeconds = std::max (valueOr ("--seconds", settings.durationSeconds), 0.0);
+    settings.sampleRate = std::max (valueOr ("--sample-rate", settings.sampleRate), 1.0);
+    settings.numChannels = std::clamp (static_cast<int> (valueOr ("--channels", settings.numChannels)), 1, 2);
+    settings.numThreads = std::max (static_cast<int> (valueOr ("--threads", settings.numThreads)), 1);
+    const int bitsPerSample = static_cast<int> (valueOr ("--bits", 24));
+
+    if (const auto timeSignature = args.getValueForOption ("--time-signature"); timeSignature.isNotEmpty())
+    {
+        settings.timeSignature.numerator = std::clamp (timeSignature.upToFirstOccurrenceOf ("/", false, false).getIntValue(), 1, 99);
+        settings.timeSignature.denominator = std::clamp (timeSignature.fromFirstOccurrenceOf ("/", false, false).getIntValue(), 1, 64);
+    }
+
+    if (const auto rampTo = args.getValueForOption ("--ramp-to"); rampTo.isNotEmpty())
+    {
+        const int rampBars = std::max (static_cast<int> (valueOr ("--ramp-bars", 16)), 1);
+        const auto curve = args.getValueForOption ("--ramp-curve") == "exponential" ? TempoMap::Curve::exponential : TempoMap::Curve::linear;
+
+        settings.tempoMap.addChange ({ 0, settings.bpm, settings.timeSignature, TempoMap::Curve::step });
+        settings.tempoMap.addChange ({ rampBars, std::clamp (rampTo.getDoubleValue(), 1.0, 10000.0), settings.timeSignature, curve });
+    }
+
+    const juce::File outputFile (juce::File::getCurrentWorkingDirectory().getChildFile (outputPath));
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto result = OfflineRenderer::renderToFile (settings, outputFile, bitsPerSample);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (result.failed())
+    {
+        std::cerr << result.getErrorMessage() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Rendered " << settings.durationSeconds << " s to " << outputFile.getFullPathName() << " in " << elapsed.count() << " s ("
+              << settings.durationSeconds / std::max (elapsed.count(), 1.0e-9) << "x real time)" << std::endl;
+    return 0;
+}